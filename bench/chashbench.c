@@ -0,0 +1,310 @@
+/*
+ *  chashbench.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * al_chash_t (concurrent hash table), stress test and throughput
+ *
+ * ./chashbench stress [nthreads [nkeys]]
+ *   threads insert, look up, increment and delete keys at the same
+ *   time, lookups are checked against values other threads set,
+ *   final contents are checked after join.  exit 1 on mismatch.
+ *
+ * ./chashbench [nkeys [ops [write% [maxthreads]]]]
+ *   lookup/set mix on preloaded keys, 1, 2, 4 .. maxthreads (ncpu) threads,
+ *   al_chash_t vs al_hash_t under one mutex.
+ *
+ * cc -O3 -I../src -o chashbench chashbench.c ../src/hash.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "alhash.h"
+
+#define MAXTHREAD 64
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+mkkey(char *buf, size_t size, long i)
+{
+  if (i % 2)
+    return snprintf(buf, size, "%ld", 100 + i);
+  return snprintf(buf, size, "Artist %ld/Album %ld/%02ld Track %ld.m4a",
+                  i / 48, i / 12, i % 12 + 1, i);
+}
+
+/*** stress ***/
+
+struct sarg {
+  struct al_chash_t *sc;   // scalar, key i -> i * 3
+  struct al_chash_t *st;   // string, key i -> "v<i>"
+  struct al_chash_t *cnt;  // shared counters
+  int id, nthread;
+  long nkeys;
+  long err;
+};
+
+#define NCOUNTER 97
+
+static void *
+stress(void *a)
+{
+  struct sarg *ap = (struct sarg *)a;
+  char key[128], val[64], buf[64];
+  long i, round;
+
+  for (round = 0; round < 2; round++) {
+    /* own keys: i % nthread == id */
+    for (i = ap->id; i < ap->nkeys; i += ap->nthread) {
+      int klen = mkkey(key, sizeof(key), i);
+      snprintf(val, sizeof(val), "v%ld", i);
+      if (citem_set_n(ap->sc, key, klen, i * 3) < 0 ||
+          citem_set_str_n(ap->st, key, klen, val) < 0) {
+        ap->err++;
+        continue;
+      }
+
+      /* keys of other threads, present or not, never wrong */
+      long j = (i * 7919 + round) % ap->nkeys;
+      value_t v;
+      klen = mkkey(key, sizeof(key), j);
+      if (citem_get_n(ap->sc, key, klen, &v) == 0 && v != j * 3) {
+        fprintf(stderr, "scalar %ld: %ld\n", j, v);
+        ap->err++;
+      }
+      snprintf(val, sizeof(val), "v%ld", j);
+      if (citem_get_str_n(ap->st, key, klen, buf, sizeof(buf)) == 0 && strcmp(buf, val)) {
+        fprintf(stderr, "string %ld: %s\n", j, buf);
+        ap->err++;
+      }
+
+      klen = snprintf(key, sizeof(key), "c%ld", i % NCOUNTER);
+      if (citem_inc_init_n(ap->cnt, key, klen, 1, NULL) < 0)
+        ap->err++;
+    }
+    /* delete own odd keys on first round, set again on second */
+    if (round == 0) {
+      for (i = ap->id; i < ap->nkeys; i += ap->nthread) {
+        if (i % 4 != 1) continue;
+        int klen = mkkey(key, sizeof(key), i);
+        if (citem_delete_n(ap->sc, key, klen) < 0 ||
+            citem_delete_n(ap->st, key, klen) < 0)
+          ap->err++;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int
+run_stress(int nthread, long nkeys)
+{
+  struct al_chash_t *sc, *st, *cnt;
+  struct sarg arg[MAXTHREAD];
+  pthread_t th[MAXTHREAD];
+  long i, err = 0;
+  int t;
+
+  /* small shards to force rehashing while threads run */
+  if (al_init_chash(HASH_TYPE_SCALAR, 4, 0, &sc) < 0 ||
+      al_init_chash(HASH_TYPE_STRING|HASH_TYPE_OPEN, 4, 0, &st) < 0 ||
+      al_init_chash(HASH_TYPE_SCALAR|HASH_TYPE_OPEN, 2, 0, &cnt) < 0) {
+    fprintf(stderr, "init chash\n");
+    return 1;
+  }
+  al_set_chash_fn(st, al_hash_fn_word);
+
+  double t0 = now();
+  for (t = 0; t < nthread; t++) {
+    arg[t] = (struct sarg){ sc, st, cnt, t, nthread, nkeys, 0 };
+    pthread_create(&th[t], NULL, stress, &arg[t]);
+  }
+  for (t = 0; t < nthread; t++) {
+    pthread_join(th[t], NULL);
+    err += arg[t].err;
+  }
+  double t1 = now();
+
+  char key[128], val[64], buf[64];
+  for (i = 0; i < nkeys; i++) {
+    int klen = mkkey(key, sizeof(key), i);
+    value_t v;
+    snprintf(val, sizeof(val), "v%ld", i);
+    if (citem_get_n(sc, key, klen, &v) < 0 || v != i * 3 ||
+        citem_get_str_n(st, key, klen, buf, sizeof(buf)) < 0 || strcmp(buf, val)) {
+      fprintf(stderr, "lost key %ld\n", i);
+      err++;
+    }
+  }
+  value_t total = 0;
+  for (i = 0; i < NCOUNTER; i++) {
+    int klen = snprintf(key, sizeof(key), "c%ld", i);
+    value_t v = 0;
+    citem_get_n(cnt, key, klen, &v);
+    total += v;
+  }
+  if (total != nkeys * 2) {
+    fprintf(stderr, "counter total %ld, expected %ld\n", total, nkeys * 2);
+    err++;
+  }
+  unsigned long n1, n2;
+  al_chash_nkeys(sc, &n1);
+  al_chash_nkeys(st, &n2);
+  if (n1 != (unsigned long)nkeys || n2 != (unsigned long)nkeys) {
+    fprintf(stderr, "nkeys %lu %lu, expected %ld\n", n1, n2, nkeys);
+    err++;
+  }
+
+  struct al_hash_stat_t stat;
+  al_chash_stat(sc, &stat, NULL);
+  printf("stress %d threads %ld keys  %.3f sec  rehash %u  %s\n",
+         nthread, nkeys, t1 - t0, stat.al_n_rehashing, err ? "FAIL" : "ok");
+
+  al_free_chash(sc);
+  al_free_chash(st);
+  al_free_chash(cnt);
+  return err ? 1 : 0;
+}
+
+/*** throughput ***/
+
+struct targ {
+  struct al_chash_t *cht;
+  struct al_hash_t *ht;
+  pthread_mutex_t *lock;
+  char **keys;
+  long nkeys, ops;
+  int wpct, id;
+};
+
+static void *
+tput(void *a)
+{
+  struct targ *ap = (struct targ *)a;
+  unsigned long r = 88172645463325252UL + ap->id;
+  long i;
+  value_t v, sum = 0;
+
+  for (i = 0; i < ap->ops; i++) {
+    r ^= r << 13; r ^= r >> 7; r ^= r << 17;  // xorshift
+    const char *key = ap->keys[r % ap->nkeys];
+    int write = (int)((r >> 32) % 100) < ap->wpct;
+    if (ap->cht) {
+      size_t klen = strlen(key);
+      if (write)
+        citem_set_n(ap->cht, key, klen, i);
+      else if (citem_get_n(ap->cht, key, klen, &v) == 0)
+        sum += v;
+    } else {
+      pthread_mutex_lock(ap->lock);
+      if (write)
+        item_set(ap->ht, key, i);
+      else if (item_get(ap->ht, key, &v) == 0)
+        sum += v;
+      pthread_mutex_unlock(ap->lock);
+    }
+  }
+  return (void *)sum;
+}
+
+static void
+run_tput(const char *name, int nthread, struct targ *proto)
+{
+  struct targ arg[MAXTHREAD];
+  pthread_t th[MAXTHREAD];
+  int t;
+
+  double t0 = now();
+  for (t = 0; t < nthread; t++) {
+    arg[t] = *proto;
+    arg[t].id = t;
+    arg[t].ops = proto->ops / nthread;
+    pthread_create(&th[t], NULL, tput, &arg[t]);
+  }
+  for (t = 0; t < nthread; t++)
+    pthread_join(th[t], NULL);
+  double t1 = now();
+  printf("%-14s %2d threads  %7.2f Mops/s\n", name, nthread, proto->ops / (t1 - t0) / 1e6);
+}
+
+int
+main(int argc, char *argv[])
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1) ncpu = 1;
+  if (MAXTHREAD < ncpu) ncpu = MAXTHREAD;
+
+  if (1 < argc && strcmp(argv[1], "stress") == 0) {
+    int nthread = 2 < argc ? atoi(argv[2]) : (ncpu < 4 ? 4 : ncpu);
+    long nkeys = 3 < argc ? atol(argv[3]) : 200000;
+    if (nthread < 1 || MAXTHREAD < nthread || nkeys <= 0) {
+      fprintf(stderr, "%s stress [nthreads [nkeys]]\n", argv[0]);
+      return 1;
+    }
+    return run_stress(nthread, nkeys);
+  }
+
+  long nkeys = 1 < argc ? atol(argv[1]) : 100000;
+  long ops = 2 < argc ? atol(argv[2]) : 8000000;
+  int wpct = 3 < argc ? atoi(argv[3]) : 10;
+  int maxth = 4 < argc ? atoi(argv[4]) : ncpu;
+  long i;
+  char buf[256];
+
+  if (nkeys <= 0 || ops <= 0 || wpct < 0 || 100 < wpct || maxth < 1 || MAXTHREAD < maxth) {
+    fprintf(stderr, "%s [nkeys [ops [write%% [maxthreads]]]]\n", argv[0]);
+    return 1;
+  }
+
+  char **keys = (char **)malloc(sizeof(char *) * nkeys);
+  if (!keys) return 1;
+  for (i = 0; i < nkeys; i++) {
+    mkkey(buf, sizeof(buf), i);
+    keys[i] = strdup(buf);
+  }
+
+  struct al_chash_t *cht;
+  struct al_hash_t *ht;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  if (al_init_chash(HASH_TYPE_SCALAR|HASH_TYPE_OPEN, 0, nkeys, &cht) < 0 ||
+      al_set_chash_fn(cht, al_hash_fn_word) < 0 ||
+      al_init_hash_capacity(HASH_TYPE_SCALAR|HASH_TYPE_OPEN, nkeys, &ht) < 0 ||
+      al_set_hash_fn(ht, al_hash_fn_word) < 0) {
+    fprintf(stderr, "init hash\n");
+    return 1;
+  }
+  for (i = 0; i < nkeys; i++) {
+    citem_set_n(cht, keys[i], strlen(keys[i]), i);
+    item_set(ht, keys[i], i);
+  }
+
+  printf("%ld keys, %ld ops, %d%% set\n", nkeys, ops, wpct);
+  struct targ proto = { NULL, ht, &lock, keys, nkeys, ops, wpct, 0 };
+  int n;
+  for (n = 1; n <= maxth; n *= 2)
+    run_tput("mutex al_hash", n, &proto);
+  proto.cht = cht;
+  for (n = 1; n <= maxth; n *= 2)
+    run_tput("al_chash", n, &proto);
+
+  al_free_chash(cht);
+  al_free_hash(ht);
+  for (i = 0; i < nkeys; i++)
+    free(keys[i]);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ *  hashbench.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * micro benchmark, al_hash_t scalar hash
+ *   chained (HASH_TYPE_SCALAR)  vs  open addressing (HASH_TYPE_OPEN)
+ *   al_hash_fn_i (FNV-1a)  vs  al_hash_fn_word
+ * sort is al_hash_iter_init(AL_SORT_DIC) and a walk over all keys.
+ * al_hash_stat histogram (chain or probe length 0..10) is printed
+ * after insertion to check bucket distribution.
+ * last, al_hash_build_bulk of the same keys, and al_hash_save/
+ * al_hash_load_mmap snapshot of the open word table.
+ *
+ * keys are track ids and Location like strings, as the track table and
+ * folderHash of itpl2dirtree hold.
+ *
+ * cc -O3 -I../src -o hashbench hashbench.c ../src/hash.c
+ * ./hashbench [nkeys [loop]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "alhash.h"
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+bench(const char *name, int type, al_hash_fn_t fn, char **keys, long nkeys, long loop)
+{
+  struct al_hash_t *ht = NULL;
+  struct al_hash_stat_t st;
+  al_chain_length_t acl;
+  long i, sum = 0, miss = 0;
+  int j;
+  char buf[64];
+
+  if (al_init_hash(type, AL_DEFAULT_HASH_BIT, &ht) < 0 ||
+      al_set_hash_fn(ht, fn) < 0) {
+    fprintf(stderr, "init %s hash\n", name);
+    exit(1);
+  }
+
+  double t0 = now();
+  for (i = 0; i < nkeys; i++)
+    item_set(ht, keys[i], i);
+  double t1 = now();
+  al_hash_stat(ht, &st, acl);
+  for (i = 0; i < loop; i++) {
+    value_t v = 0;
+    item_get(ht, keys[(i * 7919) % nkeys], &v);
+    sum += v;
+  }
+  double t2 = now();
+  for (i = 0; i < loop; i++) {
+    snprintf(buf, sizeof(buf), "%ld", nkeys * 2 + i % nkeys);
+    if (item_key(ht, buf) < 0) miss++;
+  }
+  double t3 = now();
+  struct al_hash_iter_t *itr;
+  const char *key;
+  value_t v;
+  if (al_hash_iter_init(ht, &itr, AL_SORT_DIC|AL_ITER_AE) == 0)
+    while (al_hash_iter(itr, &key, &v) == 0)
+      sum += v;
+  double t4 = now();
+  al_free_hash(ht);
+  double t5 = now();
+
+  printf("%-13s insert %.1f ns  hit %.1f ns  miss %.1f ns  sort %.3f sec  free %.3f sec  (%ld %ld)\n",
+         name, (t1 - t0) * 1e9 / nkeys, (t2 - t1) * 1e9 / loop,
+         (t3 - t2) * 1e9 / loop, t4 - t3, t5 - t4, sum, miss);
+  printf("%-13s bit %u ", "", st.al_hash_bit);
+  for (j = 0; j < 11; j++)
+    printf(" %lu", acl[j]);
+  printf("\n");
+}
+
+static void
+bench_bulk(char **keys, long nkeys)
+{
+  struct al_hash_t *ht = NULL;
+  struct al_hash_stat_t st;
+  al_chain_length_t acl;
+  int j;
+
+  if (al_init_hash(HASH_TYPE_SCALAR|HASH_TYPE_OPEN, AL_DEFAULT_HASH_BIT, &ht) < 0 ||
+      al_set_hash_fn(ht, al_hash_fn_word) < 0) {
+    fprintf(stderr, "init bulk hash\n");
+    exit(1);
+  }
+  double t0 = now();
+  int ret = al_hash_build_bulk(ht, (const char **)keys, NULL, nkeys);
+  double t1 = now();
+  if (ret < 0) {
+    fprintf(stderr, "al_hash_build_bulk %d\n", ret);
+    exit(1);
+  }
+  al_hash_stat(ht, &st, acl);
+  al_free_hash(ht);
+
+  printf("%-13s insert %.1f ns\n", "bulk word", (t1 - t0) * 1e9 / nkeys);
+  printf("%-13s bit %u ", "", st.al_hash_bit);
+  for (j = 0; j < 11; j++)
+    printf(" %lu", acl[j]);
+  printf("\n");
+}
+
+static void
+bench_snap(char **keys, long nkeys, long loop)
+{
+  struct al_hash_t *ht = NULL;
+  struct al_hash_mmap_t *mp = NULL;
+  char path[] = "/tmp/hashbenchXXXXXX";
+  long i, sum = 0, miss = 0;
+  char buf[64];
+
+  int fd = mkstemp(path);
+  if (fd < 0 ||
+      al_init_hash(HASH_TYPE_SCALAR|HASH_TYPE_OPEN, AL_DEFAULT_HASH_BIT, &ht) < 0 ||
+      al_set_hash_fn(ht, al_hash_fn_word) < 0) {
+    fprintf(stderr, "init snapshot\n");
+    exit(1);
+  }
+  for (i = 0; i < nkeys; i++)
+    item_set(ht, keys[i], i);
+
+  double t0 = now();
+  int ret = al_hash_save(ht, fd);
+  close(fd);
+  double t1 = now();
+  if (ret == 0)
+    ret = al_hash_load_mmap(path, &mp);
+  double t2 = now();
+  unlink(path);
+  al_free_hash(ht);
+  if (ret < 0) {
+    fprintf(stderr, "snapshot %d\n", ret);
+    exit(1);
+  }
+  for (i = 0; i < loop; i++) {
+    const char *key = keys[(i * 7919) % nkeys];
+    value_t v = 0;
+    mitem_get_n(mp, key, strlen(key), &v);
+    sum += v;
+  }
+  double t3 = now();
+  for (i = 0; i < loop; i++) {
+    int len = snprintf(buf, sizeof(buf), "%ld", nkeys * 2 + i % nkeys);
+    if (mitem_key_n(mp, buf, len) < 0) miss++;
+  }
+  double t4 = now();
+  al_hash_unmap(mp);
+
+  printf("%-13s save %.3f sec  load %.1f us  hit %.1f ns  miss %.1f ns  (%ld %ld)\n",
+         "snapshot", t1 - t0, (t2 - t1) * 1e6, (t3 - t2) * 1e9 / loop,
+         (t4 - t3) * 1e9 / loop, sum, miss);
+}
+
+int
+main(int argc, char *argv[])
+{
+  long nkeys = 1 < argc ? atol(argv[1]) : 100000;
+  long loop = 2 < argc ? atol(argv[2]) : 10000000;
+  long i;
+  char buf[256];
+
+  if (nkeys <= 0 || loop <= 0) {
+    fprintf(stderr, "%s [nkeys [loop]]\n", argv[0]);
+    return 1;
+  }
+
+  char **keys = (char **)malloc(sizeof(char *) * nkeys);
+  if (!keys) return 1;
+  for (i = 0; i < nkeys; i++) {
+    if (i % 2)
+      snprintf(buf, sizeof(buf), "%ld", 100 + i);
+    else
+      snprintf(buf, sizeof(buf), "Artist %ld/Album %ld/%02ld Track %ld.m4a",
+               i / 48, i / 12, i % 12 + 1, i);
+    keys[i] = strdup(buf);
+  }
+
+  bench("chained fnv", HASH_TYPE_SCALAR, al_hash_fn_i, keys, nkeys, loop);
+  bench("chained word", HASH_TYPE_SCALAR, al_hash_fn_word, keys, nkeys, loop);
+  bench("open fnv", HASH_TYPE_SCALAR|HASH_TYPE_OPEN, al_hash_fn_i, keys, nkeys, loop);
+  bench("open word", HASH_TYPE_SCALAR|HASH_TYPE_OPEN, al_hash_fn_word, keys, nkeys, loop);
+  bench_bulk(keys, nkeys);
+  bench_snap(keys, nkeys, loop);
+
+  for (i = 0; i < nkeys; i++)
+    free(keys[i]);
+  free(keys);
+  return 0;
+}
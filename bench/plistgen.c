@@ -0,0 +1,278 @@
+/*
+ *  plistgen.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * synthetic iTunes library XML generator for benchmarks
+ *
+ * cc -O2 -o plistgen plistgen.c
+ * ./plistgen [-t tracks] [-l playlists] [-i items] [-d depth] [-L loclen]
+ *            [-r seed] [-m musicdir] > library.xml
+ *
+ *  -t: number of tracks (default 10000)
+ *  -l: number of playlists (default 100)
+ *  -i: items per playlist (default 100)
+ *  -d: folder nesting depth, playlists are spread over the levels (default 2)
+ *  -L: approximate length of Location string (default 120)
+ *  -r: random seed (default 1)
+ *  -m: create empty music files under musicdir, matching Location
+ *
+ * Location prefix is PREFIX below, itpl2dirtree -i option takes it.
+ * A master playlist "Library" holding all tracks is also written,
+ * as iTunes does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PREFIX "file:///Users/bench/Music/"
+#define TRACKS_PER_ALBUM 12
+#define ALBUMS_PER_ARTIST 4
+#define NFOLDERCHAIN 2       // top level folders, each nested -d deep
+
+static long o_tracks = 10000;
+static long o_playlists = 100;
+static long o_items = 100;
+static int o_depth = 2;
+static int o_loclen = 120;
+static unsigned int o_seed = 1;
+static char *o_music = NULL;
+
+static unsigned long rnd_state;
+
+static unsigned long
+rnd()
+{
+  rnd_state = rnd_state * 6364136223846793005UL + 1442695040888963407UL;
+  return rnd_state >> 33;
+}
+
+static void
+usage(char *file)
+{
+  fprintf(stderr, "%s [-t tracks] [-l playlists] [-i items] [-d depth] [-L loclen] [-r seed] [-m musicdir]\n", file);
+  exit(1);
+}
+
+/*
+ * relative path of track i (not escaped), padded to about o_loclen
+ */
+static void
+track_path(long i, char *buf, int bufsize)
+{
+  long album = i / TRACKS_PER_ALBUM;
+  long artist = album / ALBUMS_PER_ARTIST;
+  int n = snprintf(buf, bufsize, "Artist %ld/Album & %ld/%02ld Track %ld",
+                   artist, album, i % TRACKS_PER_ALBUM + 1, i);
+  int pad = o_loclen - (int)strlen(PREFIX) - n - 4 - 8; // ".m4a", escapes
+  while (0 < pad-- && n < bufsize - 5) {
+    char c = 'a' + (i + n) % 26;
+    buf[n++] = c;
+  }
+  snprintf(buf + n, bufsize - n, ".m4a");
+}
+
+/* Location escape, as iTunes does: ' ' -> %20, XML '&' -> &#38; */
+static void
+put_location(const char *path)
+{
+  fputs(PREFIX, stdout);
+  for (; *path; path++) {
+    if (*path == ' ') fputs("%20", stdout);
+    else if (*path == '&') fputs("&#38;", stdout);
+    else putchar(*path);
+  }
+}
+
+static void
+mkdirs(char *path)
+{
+  char *sl;
+  for (sl = strchr(path + 1, '/'); sl; sl = strchr(sl + 1, '/')) {
+    *sl = '\0';
+    if (mkdir(path, 0777) < 0 && errno != EEXIST) {
+      perror(path);
+      exit(1);
+    }
+    *sl = '/';
+  }
+}
+
+static void
+make_file(const char *rel)
+{
+  char path[4096];
+  if ((int)sizeof(path) <= snprintf(path, sizeof(path), "%s/%s", o_music, rel)) {
+    fprintf(stderr, "path too long: %s/%s\n", o_music, rel);
+    exit(1);
+  }
+  int fd = open(path, O_WRONLY | O_CREAT, 0666);
+  if (fd < 0 && errno == ENOENT) {
+    mkdirs(path);
+    fd = open(path, O_WRONLY | O_CREAT, 0666);
+  }
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  close(fd);
+}
+
+static long
+track_id(long i)
+{
+  return 100 + i * 2;
+}
+
+static void
+tracks()
+{
+  char rel[4096];
+  long i;
+
+  printf("\t<key>Tracks</key>\n\t<dict>\n");
+  for (i = 0; i < o_tracks; i++) {
+    long album = i / TRACKS_PER_ALBUM;
+    track_path(i, rel, sizeof(rel));
+    if (o_music) make_file(rel);
+
+    printf("\t\t<key>%ld</key>\n\t\t<dict>\n", track_id(i));
+    printf("\t\t\t<key>Track ID</key><integer>%ld</integer>\n", track_id(i));
+    printf("\t\t\t<key>Name</key><string>Track %ld</string>\n", i);
+    printf("\t\t\t<key>Artist</key><string>Artist %ld</string>\n", album / ALBUMS_PER_ARTIST);
+    printf("\t\t\t<key>Album</key><string>Album &#38; %ld</string>\n", album);
+    printf("\t\t\t<key>Kind</key><string>AAC audio file</string>\n");
+    printf("\t\t\t<key>Size</key><integer>%lu</integer>\n", 3000000 + rnd() % 9000000);
+    printf("\t\t\t<key>Total Time</key><integer>%lu</integer>\n", 120000 + rnd() % 300000);
+    printf("\t\t\t<key>Track Number</key><integer>%ld</integer>\n", i % TRACKS_PER_ALBUM + 1);
+    printf("\t\t\t<key>Date Added</key><date>2015-04-01T12:34:56Z</date>\n");
+    printf("\t\t\t<key>Bit Rate</key><integer>256</integer>\n");
+    printf("\t\t\t<key>Sample Rate</key><integer>44100</integer>\n");
+    printf("\t\t\t<key>Persistent ID</key><string>%016lX</string>\n", 0x1000000000000000UL + i);
+    printf("\t\t\t<key>Track Type</key><string>File</string>\n");
+    printf("\t\t\t<key>Location</key><string>");
+    put_location(rel);
+    printf("</string>\n");
+    printf("\t\t\t<key>File Folder Count</key><integer>5</integer>\n");
+    printf("\t\t\t<key>Library Folder Count</key><integer>1</integer>\n");
+    printf("\t\t</dict>\n");
+  }
+  printf("\t</dict>\n");
+}
+
+static void
+playlist_head(const char *name, const char *pid, const char *ppid, int folder, int master)
+{
+  printf("\t\t<dict>\n");
+  if (master) printf("\t\t\t<key>Master</key><true/>\n");
+  printf("\t\t\t<key>Playlist ID</key><integer>%lu</integer>\n", 10000 + rnd() % 90000);
+  printf("\t\t\t<key>Playlist Persistent ID</key><string>%s</string>\n", pid);
+  if (ppid) printf("\t\t\t<key>Parent Persistent ID</key><string>%s</string>\n", ppid);
+  if (master) printf("\t\t\t<key>Visible</key><false/>\n");
+  printf("\t\t\t<key>All Items</key><true/>\n");
+  if (folder) printf("\t\t\t<key>Folder</key><true/>\n");
+  printf("\t\t\t<key>Name</key><string>%s</string>\n", name);
+  printf("\t\t\t<key>Playlist Items</key>\n\t\t\t<array>\n");
+}
+
+static void
+playlist_item(long i)
+{
+  printf("\t\t\t\t<dict>\n\t\t\t\t\t<key>Track ID</key><integer>%ld</integer>\n\t\t\t\t</dict>\n",
+         track_id(i));
+}
+
+static void
+playlist_tail()
+{
+  printf("\t\t\t</array>\n\t\t</dict>\n");
+}
+
+static void
+folder_pid(char *buf, int chain, int level)
+{
+  sprintf(buf, "F%03d%012d", chain, level);
+}
+
+static void
+playlists()
+{
+  char pid[32], ppid[32], name[64];
+  long i, j;
+  int c, d;
+
+  printf("\t<key>Playlists</key>\n\t<array>\n");
+
+  playlist_head("Library", "0000000000000000", NULL, 0, 1);
+  for (i = 0; i < o_tracks; i++)
+    playlist_item(i);
+  playlist_tail();
+
+  /* folders first, parent before child */
+  for (c = 0; c < NFOLDERCHAIN; c++) {
+    for (d = 0; d < o_depth; d++) {
+      folder_pid(pid, c, d);
+      if (d) folder_pid(ppid, c, d - 1);
+      snprintf(name, sizeof(name), "Folder %d-%d", c, d);
+      playlist_head(name, pid, d ? ppid : NULL, 1, 0);
+      playlist_tail();
+    }
+  }
+
+  for (j = 0; j < o_playlists; j++) {
+    c = j % NFOLDERCHAIN;
+    d = (j / NFOLDERCHAIN) % o_depth;
+    sprintf(pid, "P%015ld", j);
+    folder_pid(ppid, c, d);
+    snprintf(name, sizeof(name), "Playlist %ld", j);
+    playlist_head(name, pid, ppid, 0, 0);
+    long start = o_tracks ? rnd() % o_tracks : 0;
+    for (i = 0; i < o_items && i < o_tracks; i++)
+      playlist_item((start + i * 7) % o_tracks);
+    playlist_tail();
+  }
+  printf("\t</array>\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int c;
+  while ((c = getopt(argc, argv, "t:l:i:d:L:r:m:")) != -1) {
+    switch (c) {
+    case 't': o_tracks = atol(optarg); break;
+    case 'l': o_playlists = atol(optarg); break;
+    case 'i': o_items = atol(optarg); break;
+    case 'd': o_depth = atoi(optarg); break;
+    case 'L': o_loclen = atoi(optarg); break;
+    case 'r': o_seed = atoi(optarg); break;
+    case 'm': o_music = optarg; break;
+    default:  usage(argv[0]);
+    }
+  }
+  if (o_tracks < 0 || o_playlists < 0 || o_items < 0) usage(argv[0]);
+  if (o_depth < 1) o_depth = 1;  // playlists without parent are not emitted
+  rnd_state = o_seed;
+
+  printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  printf("<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n");
+  printf("<plist version=\"1.0\">\n<dict>\n");
+  printf("\t<key>Major Version</key><integer>1</integer>\n");
+  printf("\t<key>Minor Version</key><integer>1</integer>\n");
+  printf("\t<key>Application Version</key><string>12.9.5.5</string>\n");
+  printf("\t<key>Music Folder</key><string>%s</string>\n", PREFIX);
+  printf("\t<key>Library Persistent ID</key><string>0123456789ABCDEF</string>\n");
+  tracks();
+  playlists();
+  printf("</dict>\n</plist>\n");
+  return 0;
+}
@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+#  run.sh
+#
+#   Use and distribution licensed under the BSD license.
+#   See the LICENSE file for full text.
+#
+# benchmark itpl2dirtree on synthetic libraries made by plistgen
+#
+#   ./run.sh [-b itpl2dirtree] [-w workdir] [-r repeat] [-e "engine args"]...
+#            [-- plistgen args] [tracks ...]
+#
+#   tracks   one library per track count (default 10000 100000)
+#   -b       itpl2dirtree binary (default ../src/itpl2dirtree)
+#   -w       work directory, removed at end (default /tmp/itpl2dirtree-bench)
+#   -r       runs per mode, the fastest is reported (default 3)
+#   -e       extra itpl2dirtree arguments to compare, e.g. -e "-j 4" -e "-u"
+#            "default" or "" is no extra argument (default)
+#   -k       keep work directory
+#
+# modes
+#   nosearch -n -n, dry run without searchFile(), music files are still
+#            stat, itpl2dirtree reads one option letter per argument
+#   dry      -n, parse and stat of music files
+#   emit     full run into an empty output directory
+#
+# output, tab separated, one line per (library, engine, mode):
+#   tracks playlists items depth loclen xmlbytes engine mode sec links
+#
+
+BIN=../src/itpl2dirtree
+WORK=/tmp/itpl2dirtree-bench
+REPEAT=3
+KEEP=0
+ENGINES=""
+GENARGS=""
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+  -b) BIN=$2; shift 2 ;;
+  -w) WORK=$2; shift 2 ;;
+  -r) REPEAT=$2; shift 2 ;;
+  -e) ENGINES="$ENGINES
+${2:-default}"; shift 2 ;;
+  -k) KEEP=1; shift ;;
+  --) shift
+      while [ $# -gt 0 ] && [ "${1#-}" != "$1" ]; do
+        GENARGS="$GENARGS $1 $2"; shift 2
+      done ;;
+  *)  break ;;
+  esac
+done
+[ -z "$ENGINES" ] && ENGINES=default
+[ $# -eq 0 ] && set -- 10000 100000
+
+case "$BIN" in /*) ;; *) BIN=$(pwd)/$BIN ;; esac
+HERE=$(cd "$(dirname "$0")" && pwd)
+GEN=$HERE/plistgen
+if [ ! -x "$GEN" ] || [ "$GEN" -ot "$HERE/plistgen.c" ]; then
+  ${CC:-cc} -O2 -o "$GEN" "$HERE/plistgen.c" || exit 1
+fi
+if [ ! -x "$BIN" ]; then
+  echo "no itpl2dirtree binary '$BIN', use -b" >&2
+  exit 1
+fi
+
+PREFIX=file:///Users/bench/Music/
+
+# genarg name default: value of plistgen option from GENARGS
+genarg() {
+  v=$(echo "$GENARGS" | awk -v o="$1" '{ for (i = 1; i < NF; i++) if ($i == o) v = $(i + 1) } END { print v }')
+  echo "${v:-$2}"
+}
+
+# now: seconds since epoch with fraction
+now() {
+  date +%s.%N
+}
+
+# one mode, fastest of REPEAT runs; prints "sec links"
+run_mode() {
+  mode=$1; shift
+  best=""
+  i=0
+  while [ $i -lt "$REPEAT" ]; do
+    rm -rf "$WORK/out"
+    mkdir -p "$WORK/out"
+    t0=$(now)
+    (cd "$WORK/out" && "$BIN" -p "$WORK/music" -i "$PREFIX" "$@" < "$WORK/lib.xml" > /dev/null 2>> "$WORK/stderr.txt")
+    t1=$(now)
+    sec=$(echo "$t0 $t1" | awk '{ printf "%.4f", $2 - $1 }')
+    if [ -z "$best" ] || [ "$(echo "$sec $best" | awk '{ print ($1 < $2) }')" = 1 ]; then
+      best=$sec
+    fi
+    i=$((i + 1))
+  done
+  links=$(find "$WORK/out" -type l | wc -l)
+  echo "$best $links"
+}
+
+printf "tracks\tplaylists\titems\tdepth\tloclen\txmlbytes\tengine\tmode\tsec\tlinks\n"
+
+for tracks in "$@"; do
+  rm -rf "$WORK"
+  mkdir -p "$WORK/music"
+  "$GEN" -t "$tracks" -m "$WORK/music" $GENARGS > "$WORK/lib.xml" || exit 1
+  bytes=$(wc -c < "$WORK/lib.xml" | tr -d ' ')
+  lib="$tracks	$(genarg -l 100)	$(genarg -i 100)	$(genarg -d 2)	$(genarg -L 120)	$bytes"
+
+  echo "$ENGINES" | while IFS= read -r eng; do
+    [ -z "$eng" ] && continue
+    name=$eng
+    [ "$eng" = default ] && eng=""
+    set -- $eng
+    for mode in nosearch dry emit; do
+      case $mode in
+      nosearch) r=$(run_mode $mode -n -n "$@") ;;
+      dry)      r=$(run_mode $mode -n "$@") ;;
+      emit)     r=$(run_mode $mode "$@") ;;
+      esac
+      printf "%s\t%s\t%s\t%s\t%s\n" "$lib" "$name" "$mode" ${r% *} ${r#* }
+    done
+  done
+done
+
+[ "$KEEP" = 1 ] || rm -rf "$WORK"
@@ -0,0 +1,81 @@
+/*
+ *  ttbench.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * micro benchmark, tag/key name -> enum _tt
+ *   ttHash (al_hash_t scalar hash, former init_tthash())  vs  tt_lookup()
+ *
+ * cc -O3 -I../src -o ttbench ttbench.c ../src/hashint.c ../src/hash.c
+ * ./ttbench [loop]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "itpl2dirtree.h"
+
+/* names seen by element_start/element_end in a typical track dict */
+static const char *sample[] = {
+  "key", "integer", "key", "string", "key", "string", "key", "string",
+  "key", "integer", "key", "date", "dict", "Track ID", "Name", "Artist",
+  "Album", "Kind", "Total Time", "Disc Number", "Track Number", "Location",
+  "Date Added", "Persistent ID", "1234", "Sample Rate", "true", "Disabled",
+};
+#define NSAMPLE (sizeof(sample) / sizeof(sample[0]))
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+main(int argc, char *argv[])
+{
+  long loop = 1 < argc ? atol(argv[1]) : 10000000;
+  long i;
+  unsigned int j;
+  long sum_h = 0, sum_l = 0;
+
+  init_tthash();
+
+  struct al_hash_t *ttHash = get_scalar_hash_capacity(_tt_last);
+  enum _tt tidx = 0;
+  for (; ttIdStr[tidx].id != _tt_last; ++tidx)
+    item_set(ttHash, ttIdStr[tidx].name, ttIdStr[tidx].id);
+
+  for (j = 0; j < NSAMPLE; j++) {
+    value_t v = -1;
+    item_get(ttHash, sample[j], &v);
+    if (v != tt_lookup(sample[j]))
+      fprintf(stderr, "mismatch '%s' %ld %d\n", sample[j], v, tt_lookup(sample[j]));
+  }
+
+  double t0 = now();
+  for (i = 0; i < loop; i++) {
+    value_t v = -1;
+    item_get(ttHash, sample[i % NSAMPLE], &v);
+    sum_h += v;
+  }
+  double t1 = now();
+  for (i = 0; i < loop; i++) {
+    sum_l += tt_lookup(sample[i % NSAMPLE]);
+  }
+  double t2 = now();
+
+  printf("ttHash    %ld lookups %.3f sec %.1f ns/lookup\n",
+         loop, t1 - t0, (t1 - t0) * 1e9 / loop);
+  printf("tt_lookup %ld lookups %.3f sec %.1f ns/lookup\n",
+         loop, t2 - t1, (t2 - t1) * 1e9 / loop);
+  if (sum_h != sum_l) fprintf(stderr, "sum mismatch %ld %ld\n", sum_h, sum_l);
+
+  al_free_hash(ttHash);
+  return 0;
+}
@@ -6,10 +6,11 @@
  * latest version see, https://github.com/evalquote/al_hash_table
  */
 
-                 /* NOT thread safe */
+     /* NOT thread safe, except al_chash_t (concurrent hash table) */
 
 #ifndef ALH_H
 #define ALH_H
+#include <stddef.h>
 #include <inttypes.h>
 
 /* switch */
@@ -58,6 +59,8 @@ struct al_heap_iter_t;
 #define HASH_TYPE_LIST		0x400
 #define HASH_TYPE_PQ		0x800
 #define HASH_TYPE_POINTER	0x1000
+/* logior to SCALAR, STRING or POINTER type, open addressing table */
+#define HASH_TYPE_OPEN		0x8000
 
 /*
  *  for skiplist only
@@ -113,11 +116,15 @@ struct al_hash_stat_t {
  *  statistics
  *   histogram of chain length of main and previous small hash table
  *   if chain length is over 10, count up [10] of returned array
+ *   HASH_TYPE_OPEN: histogram of probe length of entries (0: home slot)
  */
 typedef unsigned long al_chain_length_t[11];
 
 /* default bit size of hash table */
 #define AL_DEFAULT_HASH_BIT 15
+/* range of bit size of al_init_hash_capacity() and al_hash_shrink() */
+#define AL_MIN_HASH_BIT 3
+#define AL_MAX_HASH_BIT 30
 
 /*
  * User API
@@ -138,8 +145,18 @@ typedef unsigned long al_chain_length_t[11];
  *       HASH_TYPE_LIST    // list is represented by cdr coding.
  *       HASH_TYPE_PQ      // priority queue
  *
+ *    HASH_TYPE_OPEN (logior to one value type)
+ *       open addressing table (Robin Hood hashing), hash value is kept
+ *       in slot and compared before key.  entries and keys are
+ *       allocated in blocks, key of deleted entry is released by
+ *       al_free_hash().  suitable for tables mostly inserted and looked up.
+ *
  * bit == 0, use AL_DEFAULT_HASH_BIT
  *
+ * al_init_hash_capacity
+ *   same as al_init_hash, but table is sized to hold n entries without
+ *   growing (smallest is AL_MIN_HASH_BIT), n == 0, use AL_DEFAULT_HASH_BIT
+ *
  * al_set_pqueue_hash_parameter
  *  sort_order: AL_SORT_DIC:         item appears dictionary order of key
  *              AL_SORT_COUNTER_DIC: item appears counter dictionary order of key
@@ -167,6 +184,7 @@ typedef unsigned long al_chain_length_t[11];
  * return -7 ht is not empty
  */
 int al_init_hash(int type, int bit, struct al_hash_t **htp);
+int al_init_hash_capacity(int type, unsigned long n, struct al_hash_t **htp);
 int al_set_pqueue_hash_parameter(struct al_hash_t *ht, int sort_order, unsigned long max_n);
 int al_set_pointer_hash_parameter(struct al_hash_t *ht,
 				  int (*dup_p)(void *ptr, unsigned int size, void **ret_v),
@@ -177,6 +195,21 @@ void *al_get_pointer_hash_pointer(const void *a);
 void *al_get_pointer_list_hash_pointer(const void *a);
 int al_init_unique_id(struct al_hash_t *ht, long id);
 
+/*
+ * hash function of key, per hash table
+ *   al_hash_fn_i     FNV-1a, byte at a time (default)
+ *   al_hash_fn_word  word at a time, faster on long keys
+ * fn == NULL, use al_hash_fn_i
+ * must be set before any item is inserted
+ *
+ * return -3 ht is NULL
+ * return -7 ht is not empty
+ */
+typedef uint32_t (*al_hash_fn_t)(const char *key, size_t len);
+uint32_t al_hash_fn_i(const char *key, size_t len);
+uint32_t al_hash_fn_word(const char *key, size_t len);
+int al_set_hash_fn(struct al_hash_t *ht, al_hash_fn_t fn);
+
 /*
  * destroy hash table
  *   ht will be free()
@@ -186,6 +219,33 @@ int al_init_unique_id(struct al_hash_t *ht, long id);
  */
 int al_free_hash(struct al_hash_t *ht);
 
+/*
+ * shrink hash table to the smallest size holding current entries
+ *   (e.g. after many item_delete), rehashing in progress is completed.
+ *   table grows again on insertion.
+ *
+ * return -3 ht is NULL
+ * return -5 iterators are attached on the hash table
+ */
+int al_hash_shrink(struct al_hash_t *ht);
+
+/*
+ * fill empty HASH_TYPE_OPEN table ht with n keys at once
+ *   table is sized for n, entries and keys are allocated in blocks
+ *   up front and placed in one pass, no per key malloc or resize.
+ *   hash function is set beforehand by al_set_hash_fn().
+ *   duplicated key, last value wins.
+ * al_hash_build_bulk      scalar hash, values == NULL: all 0
+ * al_hash_build_bulk_str  string hash, values are copied
+ *
+ * return -2 allocation fails, entries placed so far remain
+ * return -3 ht is NULL, keys or keys[i] is NULL
+ * return -6 ht is not open addressing, or not scalar/string hash
+ * return -7 ht is not empty
+ */
+int al_hash_build_bulk(struct al_hash_t *ht, const char **keys, const value_t *values, size_t n);
+int al_hash_build_bulk_str(struct al_hash_t *ht, const char **keys, const cstr_value_t *values, size_t n);
+
 /*
  * get statistics
  *
@@ -234,6 +294,21 @@ int item_set_str(struct al_hash_t *ht, const char *key, cstr_value_t v);
 int item_set_pointer(struct al_hash_t *ht, const char *key, void *v, unsigned int size);
 int item_set_pointer2(struct al_hash_t *ht, const char *key, void *v, unsigned int size, void **ret_v);
 
+/*
+ * _n variants take key as (pointer, length), key need not be NUL terminated
+ * (e.g. text in parser buffer), it must not contain '\0'.
+ * stored key is NUL terminated, as iterators return it.
+ */
+int item_key_n(struct al_hash_t *ht, const char *key, size_t klen);
+int item_get_n(struct al_hash_t *ht, const char *key, size_t klen, value_t *ret_v);
+int item_get_str_n(struct al_hash_t *ht, const char *key, size_t klen, cstr_value_t *ret_v);
+int item_get_pointer_n(struct al_hash_t *ht, const char *key, size_t klen, void **ret_v);
+int item_set_n(struct al_hash_t *ht, const char *key, size_t klen, value_t v);
+int item_set_str_n(struct al_hash_t *ht, const char *key, size_t klen, cstr_value_t v);
+int item_set_pointer_n(struct al_hash_t *ht, const char *key, size_t klen, void *v, unsigned int size);
+int item_set_pointer2_n(struct al_hash_t *ht, const char *key, size_t klen,
+                        void *v, unsigned int size, void **ret_v);
+
 /*
  * add value to list or pqueue hashtable
  * return -2, allocation fails
@@ -320,6 +395,90 @@ int item_inc(struct al_hash_t *ht, const char *key, value_t off, value_t *ret_v)
 int item_inc_init(struct al_hash_t *ht, const char *key, value_t off, value_t *ret_v);
 int item_inc_init2(struct al_hash_t *ht, const char *key, value_t off, value_t init, value_t *ret_v);
 
+/*
+ * concurrent hash table, may be shared by threads
+ *
+ *   lock striped, keys are spread over 1 << shard_bit al_hash_t (shards),
+ *   each guarded by its rwlock.  lookups of a shard run in parallel,
+ *   set/delete lock one shard.  no iterators.
+ *
+ * al_init_chash
+ *   type: HASH_TYPE_SCALAR, HASH_TYPE_STRING or HASH_TYPE_POINTER,
+ *         logior HASH_TYPE_OPEN
+ *   shard_bit: 0, use AL_DEFAULT_CHASH_SHARD_BIT
+ *   n: expected number of entries, shards are sized by al_init_hash_capacity
+ * al_set_chash_fn, al_set_pointer_chash_parameter
+ *   as al_set_hash_fn, al_set_pointer_hash_parameter, call before sharing.
+ *   dup_p and free_p are called under a shard lock, from any thread.
+ * al_free_chash
+ *   call after all threads stop using cht
+ *
+ * citem_xxx_n
+ *   same as item_xxx_n on al_hash_t, key is (pointer, length)
+ *   citem_get_str_n copies value to buf (size bytes, including '\0'),
+ *     return -8, value is truncated
+ *   citem_get_pointer_n returned pointer is owned by the table, valid until
+ *     the key is set again or deleted
+ *   citem_inc_init_n, *ret_v is not modified when key is added
+ */
+#define AL_DEFAULT_CHASH_SHARD_BIT 6
+#define AL_MAX_CHASH_SHARD_BIT 12
+
+struct al_chash_t;
+
+int al_init_chash(int type, int shard_bit, unsigned long n, struct al_chash_t **chtp);
+int al_set_chash_fn(struct al_chash_t *cht, al_hash_fn_t fn);
+int al_set_pointer_chash_parameter(struct al_chash_t *cht,
+				   int (*dup_p)(void *ptr, unsigned int size, void **ret_v),
+				   void (*free_p)(void *ptr));
+int al_free_chash(struct al_chash_t *cht);
+int al_chash_nkeys(struct al_chash_t *cht, unsigned long *nkeys);
+int al_chash_stat(struct al_chash_t *cht, struct al_hash_stat_t *statp, al_chain_length_t acl);
+
+int citem_key_n(struct al_chash_t *cht, const char *key, size_t klen);
+int citem_get_n(struct al_chash_t *cht, const char *key, size_t klen, value_t *ret_v);
+int citem_get_str_n(struct al_chash_t *cht, const char *key, size_t klen, char *buf, size_t size);
+int citem_get_pointer_n(struct al_chash_t *cht, const char *key, size_t klen, void **ret_v);
+int citem_set_n(struct al_chash_t *cht, const char *key, size_t klen, value_t v);
+int citem_set_str_n(struct al_chash_t *cht, const char *key, size_t klen, cstr_value_t v);
+int citem_set_pointer_n(struct al_chash_t *cht, const char *key, size_t klen,
+			void *v, unsigned int size, void **ret_v);
+int citem_inc_init_n(struct al_chash_t *cht, const char *key, size_t klen, value_t off, value_t *ret_v);
+int citem_delete_n(struct al_chash_t *cht, const char *key, size_t klen);
+
+/*
+ * snapshot of scalar or string hash table (also HASH_TYPE_OPEN)
+ *
+ * al_hash_save
+ *   write ht to fd as a position independent file, keys and values are
+ *   copied.  hash function must be al_hash_fn_i or al_hash_fn_word.
+ * al_hash_load_mmap
+ *   map snapshot file read only, no parsing, entries are served from
+ *   the mapping.  *mpp is valid until al_hash_unmap().
+ * mitem_xxx_n
+ *   same as item_xxx_n, mitem_get_str_n returns pointer into the mapping
+ * mitem_at, mitem_at_str
+ *   i th entry (0 <= i < nkeys) in dictionary order of key
+ *
+ * return -1, key is not found, i is out of range
+ * return -2, allocation fails
+ * return -6, not scalar/string hash, or other hash function (save),
+ *            scalar/string mismatch (get)
+ * return -11, I/O error (errno is set)
+ * return -12, not a snapshot file, or built on other byte order
+ */
+struct al_hash_mmap_t;
+
+int al_hash_save(struct al_hash_t *ht, int fd);
+int al_hash_load_mmap(const char *path, struct al_hash_mmap_t **mpp);
+int al_hash_unmap(struct al_hash_mmap_t *mp);
+int al_hash_mmap_nkeys(struct al_hash_mmap_t *mp, unsigned long *nkeys);
+int mitem_key_n(struct al_hash_mmap_t *mp, const char *key, size_t klen);
+int mitem_get_n(struct al_hash_mmap_t *mp, const char *key, size_t klen, value_t *ret_v);
+int mitem_get_str_n(struct al_hash_mmap_t *mp, const char *key, size_t klen, cstr_value_t *ret_v);
+int mitem_at(struct al_hash_mmap_t *mp, unsigned long i, const char **key, value_t *ret_v);
+int mitem_at_str(struct al_hash_mmap_t *mp, unsigned long i, const char **key, cstr_value_t *ret_v);
+
 /* iterators */
 
 /*
@@ -0,0 +1,130 @@
+/*
+ *  arena.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * bump allocator, objects are never freed one by one,
+ * all blocks are released at once by arena_free()
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "itpl2dirtree.h"
+
+#define ARENA_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static struct _arena_blk *
+new_blk(size_t size)
+{
+  struct _arena_blk *bp =
+    (struct _arena_blk *)malloc(sizeof(struct _arena_blk) + size);
+  if (!bp) {
+    fprintf(stderr, "arena malloc failed %lu\n", (unsigned long)size);
+    exit(1);
+  }
+  bp->used = 0;
+  bp->size = size;
+  return bp;
+}
+
+void *
+arena_alloc(struct _arena *ap, size_t size)
+{
+  size = ARENA_ALIGN(size);
+  struct _arena_blk *bp = ap->blk;
+
+  if (ARENA_BLKSIZE / 4 < size) { // large object, own block behind current one
+    struct _arena_blk *lp = new_blk(size);
+    if (bp) {
+      lp->next = bp->next;
+      bp->next = lp;
+    } else {
+      lp->next = NULL;
+      ap->blk = lp;
+    }
+    lp->used = size;
+    return lp->buf;
+  }
+
+  if (!bp || bp->size < bp->used + size) {
+    bp = new_blk(ARENA_BLKSIZE);
+    bp->next = ap->blk;
+    ap->blk = bp;
+  }
+  void *ret = bp->buf + bp->used;
+  bp->used += size;
+  return ret;
+}
+
+char *
+arena_strdup(struct _arena *ap, const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *ret = (char *)arena_alloc(ap, len);
+  memcpy(ret, s, len);
+  return ret;
+}
+
+/*
+ * return same pointer for same string,
+ * for the fields which have few distinct values (kind, artist, album)
+ */
+char *
+arena_intern(struct _arena *ap, const char *s, size_t len)
+{
+  value_t v = 0;
+  if (!ap->intern) {
+    ap->intern = get_scalar_hash();
+    if (!ap->intern) return arena_strdup(ap, s);
+    al_set_hash_err_msg(ap->intern, "intern:");
+  }
+  if (item_get_n(ap->intern, s, len, &v) == 0)
+    return (char *)v;
+
+  char *ret = arena_strdup(ap, s);
+  int r = item_set_n(ap->intern, s, len, (value_t)ret);
+  if (r < 0) fprintf(stderr, "arena_intern item_set %d\n", r);
+  return ret;
+}
+
+/*
+ * move all objects of src to dst, src becomes empty,
+ * strings interned in src are not shared with dst
+ */
+void
+arena_merge(struct _arena *dst, struct _arena *src)
+{
+  struct _arena_blk *bp = src->blk;
+  if (bp) {
+    while (bp->next) bp = bp->next;
+    bp->next = dst->blk;
+    dst->blk = src->blk;  // continue allocating in head of src
+  }
+  src->blk = NULL;
+  if (src->intern) {
+    int ret = al_free_hash(src->intern);
+    if (ret < 0) fprintf(stderr, "free intern %d\n", ret);
+    src->intern = NULL;
+  }
+}
+
+void
+arena_free(struct _arena *ap)
+{
+  struct _arena_blk *bp = ap->blk;
+  while (bp) {
+    struct _arena_blk *next = bp->next;
+    free((void *)bp);
+    bp = next;
+  }
+  ap->blk = NULL;
+  if (ap->intern) {
+    int ret = al_free_hash(ap->intern);
+    if (ret < 0) fprintf(stderr, "free intern %d\n", ret);
+    ap->intern = NULL;
+  }
+}
@@ -0,0 +1,173 @@
+/*
+ *  fdcache.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * cached directory file descriptors, so that mkdir/symlink/utimensat
+ * and stat of music files do not walk the whole path every time
+ *
+ *  output side: o_pldir (-o) and one fd per playlist directory
+ *  source side: o_path (-p) and a small per thread cache of the
+ *               directories holding music files
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "itpl2dirtree.h"
+
+#define SRCCACHESIZE 16  // per thread, direct mapped
+
+extern char *o_path;
+extern char *o_pldir;
+
+static int pldirrootfd = -1;  // o_pldir
+static int srcrootfd = -1;    // o_path
+static int srcoff = 0;        // length of "o_path/"
+
+struct _srcdir {
+  char *dir;   // relative to o_path, NULL: empty slot
+  int fd;
+};
+static __thread struct _srcdir srccache[SRCCACHESIZE];
+
+/*
+ * open source side root, call before workers start
+ */
+void
+fdcache_init()
+{
+  srcrootfd = open(o_path[0] ? o_path : "/", O_RDONLY | O_DIRECTORY);
+  srcoff = strlen(o_path) + 1;
+}
+
+/*
+ * return fd of o_pldir, create it if not exists
+ * return -1, cannot open
+ */
+int
+pldir_rootfd()
+{
+  if (pldirrootfd < 0) {
+    mkdir(o_pldir, 0777);
+    pldirrootfd = open(o_pldir, O_RDONLY | O_DIRECTORY);
+  }
+  return pldirrootfd;
+}
+
+/*
+ * open playlist directory name (relative to o_pldir)
+ * return NULL, cannot open, use path names instead
+ */
+struct _pldir *
+pldir_open(const char *name)
+{
+  int rfd = pldir_rootfd();
+  if (rfd < 0) return NULL;
+
+  int fd = openat(rfd, name, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) return NULL;
+
+  struct _pldir *pd = (struct _pldir *)malloc(sizeof(struct _pldir));
+  if (!pd) {
+    close(fd);
+    return NULL;
+  }
+  pd->fd = fd;
+  pd->ref = 1;
+  return pd;
+}
+
+struct _pldir *
+pldir_hold(struct _pldir *pd)
+{
+  if (pd) __sync_add_and_fetch(&pd->ref, 1);
+  return pd;
+}
+
+void
+pldir_release(struct _pldir *pd)
+{
+  if (pd && __sync_sub_and_fetch(&pd->ref, 1) == 0) {
+    close(pd->fd);
+    free(pd);
+  }
+}
+
+static unsigned int
+dir_hash(const char *cp, int len)
+{
+  uint32_t hv = 2166136261U;
+  while (0 < len--) {
+    hv ^= (uint32_t)(unsigned char)*cp++;
+    hv *= 16777619U;
+  }
+  return hv % SRCCACHESIZE;
+}
+
+/*
+ * stat(path1), path1 is "o_path/..." made by command()
+ */
+int
+src_stat(const char *path1, struct stat *stp)
+{
+  if (srcrootfd < 0 || (int)strlen(path1) < srcoff)
+    return stat(path1, stp);
+
+  const char *rel = path1 + srcoff;
+  const char *sl = strrchr(rel, '/');
+  if (!sl)
+    return fstatat(srcrootfd, rel, stp, 0);
+
+  int dlen = sl - rel;
+  struct _srcdir *cp = &srccache[dir_hash(rel, dlen)];
+  if (!cp->dir || strncmp(cp->dir, rel, dlen) != 0 || cp->dir[dlen] != '\0') {
+    if (cp->dir) {
+      close(cp->fd);
+      free(cp->dir);
+      cp->dir = NULL;
+    }
+    char *dir = strndup(rel, dlen);
+    if (!dir)
+      return stat(path1, stp);
+    int fd = openat(srcrootfd, dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) { // missing directory or EMFILE, searchFile() may find it
+      free(dir);
+      return stat(path1, stp);
+    }
+    cp->dir = dir;
+    cp->fd = fd;
+  }
+  return fstatat(cp->fd, sl + 1, stp, 0);
+}
+
+/*
+ * close source side cache of calling thread
+ */
+void
+srccache_close()
+{
+  int i;
+  for (i = 0; i < SRCCACHESIZE; i++) {
+    if (srccache[i].dir) {
+      close(srccache[i].fd);
+      free(srccache[i].dir);
+      srccache[i].dir = NULL;
+    }
+  }
+}
+
+void
+fdcache_close()
+{
+  srccache_close();
+  if (0 <= srcrootfd) close(srcrootfd);
+  if (0 <= pldirrootfd) close(pldirrootfd);
+  srcrootfd = pldirrootfd = -1;
+}
@@ -10,6 +10,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "alhash.h"
 
 /*
@@ -67,6 +73,8 @@ struct item {
   struct item *chain;
   char *key;
   union item_u u;
+  unsigned int hv;   // ht->hash_fn(key, klen)
+  unsigned int klen; // strlen(key)
 };
 
 #define HASH_FLAG_PQ_SORT_DIC   AL_SORT_DIC
@@ -83,6 +91,7 @@ struct item {
 #define HASH_FLAG_POINTER       HASH_TYPE_POINTER
 #define HASH_TYPE_MASK          (HASH_TYPE_SCALAR|HASH_TYPE_STRING|HASH_TYPE_LIST|HASH_TYPE_PQ|HASH_TYPE_POINTER)
 #define HASH_FLAG_PARAM_SET     (HASH_TYPE_POINTER<<1)
+#define HASH_FLAG_OPEN          HASH_TYPE_OPEN
 
 #define ITER_FLAG_AE            0x10000   // call end() at end of iteration
 #define ITER_FLAG_VIRTUAL       0x80000   // virtual hash_iter created
@@ -90,6 +99,35 @@ struct item {
 
 #define hash_size(n) (1U<<(n))
 
+/*
+ * open addressing table (HASH_TYPE_OPEN)
+ *
+ * slot array of (32 bit hash tag, entry index), Robin Hood linear
+ * probing with backward shift deletion.
+ * entries are allocated in fixed size blocks and never move,
+ * keys are copied to a key slab.  lookup compares tags before
+ * touching any entry or key.
+ * deleted entry is not reused (its key is NULL), the key string
+ * stays in the slab until al_free_hash().
+ */
+#define OA_EMPTY   0            // idx of unused slot
+#define OA_BLKBIT  10
+#define OA_BLKSIZE (1U<<OA_BLKBIT)
+#define OA_KEYBLK  65536
+#define OA_ITEM(ht, i) (&(ht)->oa_blk[(i) >> OA_BLKBIT][(i) & (OA_BLKSIZE - 1)])
+
+struct oa_slot {
+  uint32_t tag;  // hash value
+  uint32_t idx;  // entry index + 1 or OA_EMPTY
+};
+
+struct oa_keyblk {
+  struct oa_keyblk *next;
+  size_t used;
+  size_t size;
+  char buf[];
+};
+
 struct al_hash_iter_t;
 
 struct al_hash_t {
@@ -117,6 +155,13 @@ struct al_hash_t {
   int (*sort_rev_p)(const void *, const void *);             // pointer hash pointer sort (rev)
   unsigned int h_flag;          // sort order, ...
   const char *err_msg;          // output on auto ended iterator abend
+  al_hash_fn_t hash_fn;         // hash function of key
+
+  struct oa_slot *oa_slot;      // open addressing, hash_size(hash_bit) slots
+  struct item **oa_blk;         // entry blocks
+  unsigned int oa_nblk;         // number of entry blocks
+  unsigned long oa_used;        // entries used, including deleted ones
+  struct oa_keyblk *oa_key;     // key slab
 };
 
 /* iterator to hash table */
@@ -183,17 +228,94 @@ hash_fn(char *cp)
 }
 #endif
 
-static uint32_t
-al_hash_fn_i(const char *cp)
+uint32_t
+al_hash_fn_i(const char *cp, size_t len)
 {
   uint32_t hv = 2166136261U;
-  while (*cp) {
+  const char *ep = cp + len;
+  while (cp < ep) {
     hv ^= (uint32_t)*cp++;
     hv *= 16777619U;
   }
   return hv;
 }
 
+/*
+ * word at a time hash, 64x64->128 bit multiply mixing (wyhash like),
+ * reads 16 bytes per step.
+ */
+#define WH_K1 0xa0761d6478bd642fUL
+#define WH_K2 0xe7037ed1a0b428dbUL
+
+static inline uint64_t
+wh_rd64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+wh_rd32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+wh_mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t r = (a ^ (b >> 29)) * (b | 1);
+  return r ^ (r >> 32);
+#endif
+}
+
+uint32_t
+al_hash_fn_word(const char *key, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)key;
+  size_t n = len;
+  uint64_t seed = WH_K1 ^ len;
+  uint64_t a, b;
+
+  while (16 < n) {
+    seed = wh_mum(wh_rd64(p) ^ WH_K2, wh_rd64(p + 8) ^ seed);
+    p += 16;
+    n -= 16;
+  }
+  if (8 <= n) { // last 8..16 bytes, may overlap
+    a = wh_rd64(p);
+    b = wh_rd64(p + n - 8);
+  } else if (4 <= n) {
+    a = wh_rd32(p);
+    b = wh_rd32(p + n - 4);
+  } else if (n) {
+    a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+    b = 0;
+  } else {
+    a = b = 0;
+  }
+  uint64_t h = wh_mum(a ^ WH_K2, b ^ seed);
+  h = wh_mum(h ^ WH_K1, len ^ WH_K2);
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+/* copy of key[0..len), NUL terminated */
+static char *
+key_dup(const char *key, size_t len)
+{
+  char *cp = (char *)malloc(len + 1);
+  if (!cp) return NULL;
+  memcpy(cp, key, len);
+  cp[len] = '\0';
+  return cp;
+}
+
 static int
 resize_hash(int bit, struct al_hash_t *ht)
 {
@@ -217,7 +339,7 @@ moving(struct al_hash_t *ht)
   for (i = 0; i < ht->moving_unit; i++) {
     struct item *it = ht->hash_table_old[ht->rehashing_front];
     while (it) {
-      unsigned int hindex = al_hash_fn_i(it->key) & ht->hash_mask;
+      unsigned int hindex = it->hv & ht->hash_mask;
       struct item *next = it->chain;
       it->chain = ht->hash_table[hindex];
       ht->hash_table[hindex] = it;
@@ -261,19 +383,181 @@ do_rehashing(struct al_hash_t *ht)
   return ret;
 }
 
+/* distance of slot i from home slot of its entry */
+#define oa_dist(sp, i, mask) (((i) - (sp)->tag) & (mask))
+
+/* Robin Hood insertion, entry far from home takes the slot */
+static void
+oa_place(struct oa_slot *slot, unsigned int mask, struct oa_slot s)
+{
+  unsigned int i = s.tag & mask;
+  unsigned int d = 0;
+
+  while (slot[i].idx != OA_EMPTY) {
+    unsigned int sd = oa_dist(&slot[i], i, mask);
+    if (sd < d) {
+      struct oa_slot t = slot[i];
+      slot[i] = s;
+      s = t;
+      d = sd;
+    }
+    i = (i + 1) & mask;
+    d++;
+  }
+  slot[i] = s;
+}
+
+/* rebuild slot array in 2^bit slots */
+static int
+oa_resize(struct al_hash_t *ht, int bit)
+{
+  struct oa_slot *slot = (struct oa_slot *)calloc(hash_size(bit), sizeof(struct oa_slot));
+  if (!slot) return -2;
+
+  unsigned int mask = hash_size(bit) - 1;
+  if (ht->oa_slot) {
+    unsigned int i;
+    for (i = 0; i <= ht->hash_mask; i++) {
+      if (ht->oa_slot[i].idx != OA_EMPTY)
+        oa_place(slot, mask, ht->oa_slot[i]);
+    }
+    free((void *)ht->oa_slot);
+    ht->n_rehashing++;
+  }
+  ht->oa_slot = slot;
+  ht->hash_bit = bit;
+  ht->hash_mask = mask;
+  return 0;
+}
+
+/* return slot index of key, or -1 */
+static long
+oa_lookup(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv)
+{
+  unsigned int i = hv & ht->hash_mask;
+  unsigned int d = 0;
+  struct oa_slot *sp;
+
+  while ((sp = &ht->oa_slot[i])->idx != OA_EMPTY &&
+         d <= oa_dist(sp, i, ht->hash_mask)) {
+    if (sp->tag == hv) {
+      struct item *it = OA_ITEM(ht, sp->idx - 1);
+      if (it->klen == klen && memcmp(key, it->key, klen) == 0)
+        return i;
+    }
+    i = (i + 1) & ht->hash_mask;
+    d++;
+  }
+  return -1;
+}
+
+static struct item *
+oa_find(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv)
+{
+  long i = oa_lookup(ht, key, klen, hv);
+  if (i < 0) return NULL;
+  return OA_ITEM(ht, ht->oa_slot[i].idx - 1);
+}
+
+static char *
+oa_strdup(struct al_hash_t *ht, const char *key, size_t klen)
+{
+  size_t len = klen + 1;
+  struct oa_keyblk *kb = ht->oa_key;
+
+  if (!kb || kb->size - kb->used < len) {
+    size_t size = len < OA_KEYBLK ? OA_KEYBLK : len;
+    kb = (struct oa_keyblk *)malloc(sizeof(struct oa_keyblk) + size);
+    if (!kb) return NULL;
+    kb->next = ht->oa_key;
+    kb->used = 0;
+    kb->size = size;
+    ht->oa_key = kb;
+  }
+  char *cp = kb->buf + kb->used;
+  memcpy(cp, key, klen);
+  cp[klen] = '\0';
+  kb->used += len;
+  return cp;
+}
+
+/* key must not be in ht */
+static int
+oa_insert(struct al_hash_t *ht, unsigned int hv, const char *key, size_t klen, union item_u u)
+{
+  int ret = 0;
+
+  /* keep 1/4 of slots empty */
+  if (ht->hash_mask - ht->hash_mask / 4 <= ht->n_entries) {
+    ret = oa_resize(ht, ht->hash_bit + 1);
+    if (ret < 0) return ret;
+  }
+
+  if (ht->oa_used == (unsigned long)ht->oa_nblk * OA_BLKSIZE) {
+    if (UINT32_MAX <= ht->oa_used) return -2;
+    struct item **blk = (struct item **)realloc(ht->oa_blk,
+                                                sizeof(struct item *) * (ht->oa_nblk + 1));
+    if (!blk) return -2;
+    ht->oa_blk = blk;
+    blk[ht->oa_nblk] = (struct item *)malloc(sizeof(struct item) * OA_BLKSIZE);
+    if (!blk[ht->oa_nblk]) return -2;
+    ht->oa_nblk++;
+  }
+
+  struct item *it = OA_ITEM(ht, ht->oa_used);
+  it->key = oa_strdup(ht, key, klen);
+  if (!it->key) return -2;
+  it->chain = NULL;
+  it->u = u;
+  it->hv = hv;
+  it->klen = klen;
+
+  struct oa_slot s = {hv, (uint32_t)++ht->oa_used};
+  oa_place(ht->oa_slot, ht->hash_mask, s);
+  ht->n_entries++;
+  return 0;
+}
+
+/* returned entry is marked as deleted (key is NULL), value is not freed */
+static struct item *
+oa_delete(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv)
+{
+  long li = oa_lookup(ht, key, klen, hv);
+  if (li < 0) return NULL;
+
+  unsigned int i = li;
+  struct item *it = OA_ITEM(ht, ht->oa_slot[i].idx - 1);
+  it->key = NULL;
+  ht->n_entries--;
+
+  /* backward shift, no tombstone */
+  unsigned int j = (i + 1) & ht->hash_mask;
+  while (ht->oa_slot[j].idx != OA_EMPTY &&
+         oa_dist(&ht->oa_slot[j], j, ht->hash_mask) != 0) {
+    ht->oa_slot[i] = ht->oa_slot[j];
+    i = j;
+    j = (j + 1) & ht->hash_mask;
+  }
+  ht->oa_slot[i].idx = OA_EMPTY;
+  return it;
+}
+
 static struct item *
-hash_find(struct al_hash_t *ht, const char *key, unsigned int hv)
+hash_find(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv)
 {
   struct item *it;
   unsigned int hindex;
 
+  if (ht->h_flag & HASH_FLAG_OPEN)
+    return oa_find(ht, key, klen, hv);
+
   if (ht->rehashing && ht->rehashing_front <= (hindex = (hv & ht->hash_mask_old)))
     it = ht->hash_table_old[hindex];
   else
     it = ht->hash_table[hv & ht->hash_mask];
 
   while (it) {
-    if (strcmp(key, it->key) == 0) // found
+    if (it->hv == hv && it->klen == klen && memcmp(key, it->key, klen) == 0) // found
       return it;
     it = it->chain;
   }
@@ -281,11 +565,13 @@ hash_find(struct al_hash_t *ht, const char *key, unsigned int hv)
 }
 
 static int
-hash_insert(struct al_hash_t *ht, unsigned int hv, const char *key, struct item *it)
+hash_insert(struct al_hash_t *ht, unsigned int hv, size_t klen, struct item *it)
 {
   int ret = 0;
   unsigned int hindex;
 
+  it->hv = hv;
+  it->klen = klen;
   if (ht->rehashing && ht->rehashing_front <= (hindex = (hv & ht->hash_mask_old))) {
     it->chain = ht->hash_table_old[hindex];
     ht->hash_table_old[hindex] = it;
@@ -307,19 +593,22 @@ hash_insert(struct al_hash_t *ht, unsigned int hv, const char *key, struct item
 }
 
 static int
-hash_v_insert(struct al_hash_t *ht, unsigned int hv, const char *key, union item_u u)
+hash_v_insert(struct al_hash_t *ht, unsigned int hv, const char *key, size_t klen, union item_u u)
 {
   int ret = 0;
+  if (ht->h_flag & HASH_FLAG_OPEN)
+    return oa_insert(ht, hv, key, klen, u);
+
   struct item *it = (struct item *)malloc(sizeof(struct item));
   if (!it) return -2;
 
   it->u = u;
-  it->key = strdup(key);
+  it->key = key_dup(key, klen);
   if (!it->key) {
     free((void *)it);
     return -2;
   }
-  ret = hash_insert(ht, hv, key, it);
+  ret = hash_insert(ht, hv, klen, it);
   if (ret < 0) {
     free((void *)it->key);
     free((void *)it);
@@ -328,13 +617,16 @@ hash_v_insert(struct al_hash_t *ht, unsigned int hv, const char *key, union item
 }
 
 static struct item *
-hash_delete(struct al_hash_t *ht, const char *key, unsigned int hv)
+hash_delete(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv)
 {
   struct item *it;
   struct item **place;
   unsigned int hindex;
   int old = 0;
 
+  if (ht->h_flag & HASH_FLAG_OPEN)
+    return oa_delete(ht, key, klen, hv);
+
   if (ht->rehashing && ht->rehashing_front <= (hindex = (hv & ht->hash_mask_old))) {
     place = &ht->hash_table_old[hindex];
     old = 1;
@@ -343,7 +635,7 @@ hash_delete(struct al_hash_t *ht, const char *key, unsigned int hv)
   }
 
   it = *place;
-  while (it && strcmp(key, it->key) != 0) {
+  while (it && (it->hv != hv || it->klen != klen || memcmp(key, it->key, klen) != 0)) {
     place = &it->chain;
     it = it->chain;
   }
@@ -359,7 +651,7 @@ hash_delete(struct al_hash_t *ht, const char *key, unsigned int hv)
 }
 
 static int
-init_hash(int bit, struct al_hash_t **htp)
+init_hash(int bit, int open, struct al_hash_t **htp)
 {
   int ret = 0;
   if (!htp) return -3;
@@ -371,10 +663,17 @@ init_hash(int bit, struct al_hash_t **htp)
   if (bit <= 0)
     bit = AL_DEFAULT_HASH_BIT;
 
-  ret = resize_hash(bit, al_hash);
-  if (ret < 0) return ret;
+  if (open)
+    ret = oa_resize(al_hash, bit);
+  else
+    ret = resize_hash(bit, al_hash);
+  if (ret < 0) {
+    free((void *)al_hash);
+    return ret;
+  }
 
   al_hash->moving_unit = 2 * bit;
+  al_hash->hash_fn = al_hash_fn_i;
   *htp = al_hash;
   return 0;
 }
@@ -382,7 +681,10 @@ init_hash(int bit, struct al_hash_t **htp)
 int
 al_init_hash(int type, int bit, struct al_hash_t **htp)
 {
+  int open = type & HASH_TYPE_OPEN;
+  type &= ~HASH_TYPE_OPEN;
   if ((type & ~HASH_TYPE_MASK) != 0) return -7;
+  if (open && (type & (HASH_TYPE_LIST|HASH_TYPE_PQ)) != 0) return -7;
   if ((type & HASH_TYPE_LIST) != 0) { // list hash
     if ((type & (HASH_TYPE_PQ)) != 0 ||
         (type & (HASH_TYPE_SCALAR|HASH_TYPE_STRING|HASH_TYPE_POINTER)) == 0 ||
@@ -399,12 +701,182 @@ al_init_hash(int type, int bit, struct al_hash_t **htp)
     return -7;
   }
 
-  int ret = init_hash(bit, htp);
+  int ret = init_hash(bit, open, htp);
   if (0 <= ret)
-    (*htp)->h_flag = type;
+    (*htp)->h_flag = type | open;
+  return ret;
+}
+
+/* smallest bit of table which holds n entries without growing */
+static int
+capacity_bit(int open, unsigned long n)
+{
+  int bit = AL_MIN_HASH_BIT;
+  unsigned long mask = hash_size(bit) - 1;
+  while (bit < AL_MAX_HASH_BIT &&
+         (open ? mask - mask / 4 < n : mask * (MEAN_CHAIN_LENGTH + 1) < n)) {
+    bit++;
+    mask = hash_size(bit) - 1;
+  }
+  return bit;
+}
+
+int
+al_init_hash_capacity(int type, unsigned long n, struct al_hash_t **htp)
+{
+  return al_init_hash(type, n ? capacity_bit(type & HASH_TYPE_OPEN, n) : 0, htp);
+}
+
+int
+al_hash_shrink(struct al_hash_t *ht)
+{
+  if (!ht) return -3;
+  if (ht->iterators) return -5;
+
+  int open = ht->h_flag & HASH_FLAG_OPEN;
+  int bit = capacity_bit(open, ht->n_entries + ht->n_entries_old);
+  if (open)
+    return bit < ht->hash_bit ? oa_resize(ht, bit) : 0;
+
+  while (ht->rehashing)
+    moving(ht);
+  if (ht->hash_bit <= bit) return 0;
+
+  struct item **old = ht->hash_table;
+  unsigned int i, old_size = hash_size(ht->hash_bit);
+  int ret = resize_hash(bit, ht);
+  if (ret < 0) {
+    ht->hash_table = old;
+    return ret;
+  }
+  for (i = 0; i < old_size; i++) {
+    struct item *it = old[i];
+    while (it) {
+      struct item *next = it->chain;
+      it->chain = ht->hash_table[it->hv & ht->hash_mask];
+      ht->hash_table[it->hv & ht->hash_mask] = it;
+      it = next;
+    }
+  }
+  free((void *)old);
+  ht->n_rehashing++;
+  return 0;
+}
+
+/*
+ * fill empty open addressing table from arrays, one of values/strs is used
+ *   pass 1 hashes all keys and sums key length, then slots, entry blocks
+ *   and one key slab are allocated for n entries, pass 2 places entries.
+ *   no resize, no per key allocation (except string values).
+ */
+static int
+build_bulk(struct al_hash_t *ht, const char **keys, size_t n,
+           const value_t *values, const cstr_value_t *strs)
+{
+  if (!ht || (!keys && n)) return -3;
+  if (!(ht->h_flag & HASH_FLAG_OPEN)) return -6;
+  if (ht->n_entries || ht->oa_used) return -7;
+  if (UINT32_MAX <= n) return -2;
+  if (n == 0) return 0;
+
+  struct oa_slot *hk = (struct oa_slot *)malloc(sizeof(struct oa_slot) * n); // {hv, klen}
+  if (!hk) return -2;
+  size_t i, ksize = 0;
+  for (i = 0; i < n; i++) {
+    if (!keys[i]) {
+      free((void *)hk);
+      return -3;
+    }
+    size_t klen = strlen(keys[i]);
+    hk[i].tag = ht->hash_fn(keys[i], klen);
+    hk[i].idx = klen;
+    ksize += klen + 1;
+  }
+
+  int ret = 0;
+  int bit = capacity_bit(1, n);
+  if (ht->hash_bit < bit)
+    ret = oa_resize(ht, bit);
+
+  unsigned int nblk = (n + OA_BLKSIZE - 1) >> OA_BLKBIT;
+  if (0 <= ret && ht->oa_nblk < nblk) {
+    struct item **blk = (struct item **)realloc(ht->oa_blk, sizeof(struct item *) * nblk);
+    if (!blk) {
+      ret = -2;
+    } else {
+      ht->oa_blk = blk;
+      while (ht->oa_nblk < nblk) {
+        blk[ht->oa_nblk] = (struct item *)malloc(sizeof(struct item) * OA_BLKSIZE);
+        if (!blk[ht->oa_nblk]) {
+          ret = -2;
+          break;
+        }
+        ht->oa_nblk++;
+      }
+    }
+  }
+  if (0 <= ret) { // oa_strdup() uses this slab for all keys
+    struct oa_keyblk *kb = (struct oa_keyblk *)malloc(sizeof(struct oa_keyblk) + ksize);
+    if (!kb) {
+      ret = -2;
+    } else {
+      kb->next = ht->oa_key;
+      kb->used = 0;
+      kb->size = ksize;
+      ht->oa_key = kb;
+    }
+  }
+
+  for (i = 0; 0 <= ret && i < n; i++) {
+    union item_u u;
+    if (strs) {
+      u.cstr = NULL;
+      if (strs[i] && !(u.cstr = strdup(strs[i]))) {
+        ret = -2;
+        break;
+      }
+    } else {
+      u.value = values ? values[i] : 0;
+    }
+
+    long li = oa_lookup(ht, keys[i], hk[i].idx, hk[i].tag);
+    if (0 <= li) { // duplicated key, last one wins as item_set
+      struct item *it = OA_ITEM(ht, ht->oa_slot[li].idx - 1);
+      if (strs)
+        free((void *)it->u.cstr);
+      it->u = u;
+      continue;
+    }
+    struct item *it = OA_ITEM(ht, ht->oa_used);
+    it->key = oa_strdup(ht, keys[i], hk[i].idx);
+    it->chain = NULL;
+    it->u = u;
+    it->hv = hk[i].tag;
+    it->klen = hk[i].idx;
+
+    struct oa_slot s = {hk[i].tag, (uint32_t)++ht->oa_used};
+    oa_place(ht->oa_slot, ht->hash_mask, s);
+    ht->n_entries++;
+  }
+  free((void *)hk);
   return ret;
 }
 
+int
+al_hash_build_bulk(struct al_hash_t *ht, const char **keys, const value_t *values, size_t n)
+{
+  if (ht && !(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
+  return build_bulk(ht, keys, n, values, NULL);
+}
+
+int
+al_hash_build_bulk_str(struct al_hash_t *ht, const char **keys, const cstr_value_t *values, size_t n)
+{
+  if (ht && !(ht->h_flag & HASH_FLAG_STRING)) return -6;
+  if (!values && n) return -3;
+  return build_bulk(ht, keys, n, NULL, values);
+}
+
 int
 al_set_pqueue_hash_parameter(struct al_hash_t *ht, int sort_order, unsigned long max_n)
 {
@@ -456,6 +928,15 @@ al_get_pointer_list_hash_pointer(const void *a)
   return (void *)a;
 }
 
+int
+al_set_hash_fn(struct al_hash_t *ht, al_hash_fn_t fn)
+{
+  if (!ht) return -3;
+  if (ht->n_entries || ht->n_entries_old) return -7;
+  ht->hash_fn = fn ? fn : al_hash_fn_i;
+  return 0;
+}
+
 int
 al_init_unique_id(struct al_hash_t *ht, long id)
 {
@@ -516,6 +997,16 @@ free_value(struct al_hash_t *ht, struct item *it)
   }
 }
 
+/* free item removed by hash_delete() */
+static void
+free_item(struct al_hash_t *ht, struct item *it)
+{
+  free_value(ht, it);
+  if (ht->h_flag & HASH_FLAG_OPEN) return; // entry and key are in slabs
+  free((void *)it->key);
+  free((void *)it);
+}
+
 static void
 free_hash(struct al_hash_t *ht, struct item **itp, unsigned int start, unsigned int size)
 {
@@ -536,23 +1027,36 @@ static void
 free_to_be_free(struct al_hash_iter_t *iterp)
 {
   if (iterp->to_be_free) {
-    free((void *)iterp->to_be_free->key);
-    free_value(iterp->ht, iterp->to_be_free);
-    free((void *)iterp->to_be_free);
+    free_item(iterp->ht, iterp->to_be_free);
     iterp->to_be_free = NULL;
   }
 }
 
+static void
+oa_free(struct al_hash_t *ht)
+{
+  unsigned long i;
+  for (i = 0; i < ht->oa_used; i++) {
+    struct item *it = OA_ITEM(ht, i);
+    if (it->key) free_value(ht, it);
+  }
+  for (i = 0; i < ht->oa_nblk; i++)
+    free((void *)ht->oa_blk[i]);
+  free((void *)ht->oa_blk);
+  free((void *)ht->oa_slot);
+
+  struct oa_keyblk *kb = ht->oa_key;
+  while (kb) {
+    struct oa_keyblk *next = kb->next;
+    free((void *)kb);
+    kb = next;
+  }
+}
+
 int
 al_free_hash(struct al_hash_t *ht)
 {
   if (!ht) return -3;
-  if (ht->rehashing) {
-    free_hash(ht, ht->hash_table_old, ht->rehashing_front, hash_size(ht->hash_bit - 1));
-    free((void *)ht->hash_table_old);
-  }
-  free_hash(ht, ht->hash_table, 0, hash_size(ht->hash_bit));
-  free((void *)ht->hash_table);
 
 #if 1 <= AL_WARN
   if (ht->iterators)
@@ -563,6 +1067,17 @@ al_free_hash(struct al_hash_t *ht)
     free_to_be_free(ip); // pointer hash needs ip->ht, to_be_free value free()ed early
     ip->ht = NULL;
   }
+
+  if (ht->h_flag & HASH_FLAG_OPEN) {
+    oa_free(ht);
+  } else {
+    if (ht->rehashing) {
+      free_hash(ht, ht->hash_table_old, ht->rehashing_front, hash_size(ht->hash_bit - 1));
+      free((void *)ht->hash_table_old);
+    }
+    free_hash(ht, ht->hash_table, 0, hash_size(ht->hash_bit));
+    free((void *)ht->hash_table);
+  }
   free((void *)ht);
   return 0;
 }
@@ -727,6 +1242,166 @@ static int
   }
 }
 
+/*
+ * radix sort of items by key, string value or scalar value
+ *   (sort key, item) pairs are sorted in a contiguous array, so items
+ *   are touched once to extract keys, not on every comparison.
+ *   strings use 8 bytes big endian as sort key, it compares as strcmp(),
+ *   runs of same 8 bytes are sorted again by next 8 bytes, or qsort()ed
+ *   when short.  descending order sorts complement of sort key.
+ */
+#define RADIX_MIN 256  // shorter arrays are qsort()ed
+
+struct skey {
+  uint64_t k;
+  struct item *it;
+};
+
+struct sort_ctx {
+  int by;    // 0: key, 1: string value, 2: scalar value
+  int rev;   // descending
+  int (*sf)(const void *, const void *);
+};
+
+/* 8 bytes of s from off, s is not shorter than off */
+static uint64_t
+skey_str(const struct sort_ctx *cp, struct item *it, int off)
+{
+  const char *s = cp->by == 0 ? it->key : it->u.cstr;
+  uint64_t k = 0;
+  int i;
+  if (s) {
+    s += off;
+    for (i = 0; i < 8 && s[i]; i++)
+      k |= (uint64_t)(unsigned char)s[i] << (56 - 8 * i);
+  }
+  return cp->rev ? ~k : k;
+}
+
+/* LSD radix sort a[n] by k using b[n], return sorted one of a and b */
+static struct skey *
+radix_sort(struct skey *a, struct skey *b, long n)
+{
+  long cnt[8][256];
+  long i;
+  int p, d;
+
+  memset((void *)cnt, 0, sizeof(cnt));
+  for (i = 0; i < n; i++) {
+    uint64_t k = a[i].k;
+    for (p = 0; p < 8; p++)
+      cnt[p][(k >> (8 * p)) & 0xff]++;
+  }
+  for (p = 0; p < 8; p++) {
+    long *c = cnt[p];
+    if (c[(a[0].k >> (8 * p)) & 0xff] == n) continue;  // same byte in all
+    long off = 0;
+    for (d = 0; d < 256; d++) {
+      long t = c[d];
+      c[d] = off;
+      off += t;
+    }
+    for (i = 0; i < n; i++)
+      b[c[(a[i].k >> (8 * p)) & 0xff]++] = a[i];
+    struct skey *t = a;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* sp[n] is sorted by 8 bytes from off, order runs of same 8 bytes */
+static void
+sort_ties(const struct sort_ctx *cp, struct skey *sp, struct skey *tmp,
+          struct item **out, long n, int off)
+{
+  long i, j, x;
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; j < n && sp[j].k == sp[i].k; j++)
+      ;
+    if (j - i < 2 || !((cp->rev ? ~sp[i].k : sp[i].k) & 0xff))
+      continue;  // single, or string ends in these 8 bytes
+    if (j - i < RADIX_MIN) {
+      qsort((void *)&out[i], j - i, sizeof(struct item *), cp->sf);
+      continue;
+    }
+    for (x = i; x < j; x++)
+      sp[x].k = skey_str(cp, sp[x].it, off + 8);
+    struct skey *r = radix_sort(&sp[i], &tmp[i], j - i);
+    for (x = 0; x < j - i; x++)
+      out[i + x] = r[x].it;
+    sort_ties(cp, r, r == &sp[i] ? &tmp[i] : &sp[i], &out[i], j - i, off + 8);
+  }
+}
+
+/* same order as qsort(it_array, n, sizeof(struct item *), sf) */
+static void
+sort_items(struct item **it_array, long n, int (*sf)(const void *, const void *))
+{
+  struct sort_ctx ctx;
+  ctx.sf = sf;
+  ctx.rev = sf == itn_cmp || sf == itn_value_cmp || sf == itn_num_value_cmp;
+  if (sf == it_cmp || sf == itn_cmp) ctx.by = 0;
+  else if (sf == it_value_cmp || sf == itn_value_cmp) ctx.by = 1;
+  else if (sf == it_num_value_cmp || sf == itn_num_value_cmp) ctx.by = 2;
+  else ctx.by = -1;
+
+  struct skey *a = NULL;
+  if (0 <= ctx.by && RADIX_MIN <= n)
+    a = (struct skey *)malloc(sizeof(struct skey) * n * 2);
+  if (!a) {
+    qsort((void *)it_array, n, sizeof(struct item *), sf);
+    return;
+  }
+
+  long i;
+  for (i = 0; i < n; i++) {
+    struct item *it = it_array[i];
+    if (ctx.by == 2) {
+      uint64_t k = (uint64_t)it->u.value ^ ((uint64_t)1 << 63);
+      a[i].k = ctx.rev ? ~k : k;
+    } else {
+      a[i].k = skey_str(&ctx, it, 0);
+    }
+    a[i].it = it;
+  }
+  struct skey *sp = radix_sort(a, a + n, n);
+  for (i = 0; i < n; i++)
+    it_array[i] = sp[i].it;
+  if (ctx.by != 2)
+    sort_ties(&ctx, sp, sp == a ? a + n : a, it_array, n, 0);
+  free((void *)a);
+}
+
+/*
+ * all entries of ht to it_array (n_entries + n_entries_old elements)
+ * return number of entries, -99 on inconsistency
+ */
+static long
+collect_items(struct al_hash_t *ht, struct item **it_array)
+{
+  long sidx = 0;
+
+  if (ht->h_flag & HASH_FLAG_OPEN) {
+    unsigned long i;
+    for (i = 0; i < ht->oa_used && sidx < ht->n_entries; i++) {
+      struct item *it = OA_ITEM(ht, i);
+      if (it->key) it_array[sidx++] = it;
+    }
+  } else {
+    if (ht->rehashing) {
+      sidx = add_it_to_array_for_sorting(it_array, sidx, ht->hash_table_old,
+                                         ht->rehashing_front, hash_size(ht->hash_bit - 1),
+                                         ht->n_entries_old);
+      if (sidx != ht->n_entries_old) return -99;
+    }
+    sidx = add_it_to_array_for_sorting(it_array, sidx, ht->hash_table,
+                                       0, hash_size(ht->hash_bit), ht->n_entries);
+  }
+  if (sidx != ht->n_entries + ht->n_entries_old) return -99;
+  return sidx;
+}
+
 inline static int
 iter_sort(struct al_hash_t *ht, struct al_hash_iter_t *ip, int flag, long topk)
 {
@@ -739,19 +1414,8 @@ iter_sort(struct al_hash_t *ht, struct al_hash_iter_t *ip, int flag, long topk)
     free((void *)ip);
     return -2;
   }
-  if (ht->rehashing) {
-    sidx = add_it_to_array_for_sorting(it_array, sidx, ht->hash_table_old,
-                                       ht->rehashing_front, hash_size(ht->hash_bit - 1),
-                                       ht->n_entries_old);
-    if (sidx != ht->n_entries_old) {
-      free((void *)it_array);
-      free((void *)ip);
-      return -99;
-    }
-  }
-  sidx = add_it_to_array_for_sorting(it_array, sidx, ht->hash_table,
-                                     0, hash_size(ht->hash_bit), ht->n_entries);
-  if (sidx != ht->n_entries + ht->n_entries_old) {
+  sidx = collect_items(ht, it_array);
+  if (sidx < 0) {
     free((void *)it_array);
     free((void *)ip);
     return -99;
@@ -775,7 +1439,7 @@ iter_sort(struct al_hash_t *ht, struct al_hash_iter_t *ip, int flag, long topk)
     }
   }
   if (topk == 0 || (flag & AL_SORT_FFK_ONLY) == 0)
-    qsort((void *)it_array, sidx, sizeof(struct item *), sf);
+    sort_items(it_array, sidx, sf);
 
   ip->sorted = it_array;
   ip->oindex = sidx;    // max index
@@ -790,6 +1454,12 @@ iter_nsort(struct al_hash_t *ht, struct al_hash_iter_t *ip)
   unsigned int total_size = old_size + hash_size(ht->hash_bit);
   struct item **place = NULL;
 
+  if (ht->h_flag & HASH_FLAG_OPEN) { // index of entry
+    ip->index = 0;
+    ip->place = NULL;
+    return 0;
+  }
+
   if (ht->rehashing) {
     index = ht->rehashing_front;
     place = &ht->hash_table_old[ht->rehashing_front];
@@ -876,6 +1546,22 @@ advance_iter(struct al_hash_iter_t *iterp, struct item **it)
     return 0;
   }
 
+  if (ht->h_flag & HASH_FLAG_OPEN) {
+    /* oindex: index of pointed entry + 1, 0: not pointed */
+    while (index < ht->oa_used) {
+      struct item *oit = OA_ITEM(ht, index);
+      index++;
+      if (oit->key) {
+        *it = oit;
+        iterp->index = iterp->oindex = index;
+        return 0;
+      }
+    }
+    iterp->index = index;
+    iterp->oindex = 0;
+    return -1;
+  }
+
   struct item **place = iterp->place;
   if (!place || !*place) {
     iterp->pplace = iterp->place = NULL;
@@ -1011,6 +1697,11 @@ item_replace_iter(struct al_hash_iter_t *iterp, value_t v)
     struct item *it = iterp->sorted[index - 1];
     if (!it) return -1;
     it->u.value = v;
+  } else if (iterp->ht->h_flag & HASH_FLAG_OPEN) {
+    if (iterp->oindex == 0) return -1;
+    struct item *it = OA_ITEM(iterp->ht, iterp->oindex - 1);
+    if (!it->key) return -1;
+    it->u.value = v;
   } else {
     if (!iterp->pplace) return -1;
     (*iterp->pplace)->u.value = v;
@@ -1025,7 +1716,7 @@ del_sorted_iter(struct al_hash_iter_t *iterp)
   if (index == 0 || iterp->oindex < index || iterp->to_be_free) return -1;
   struct item *it = iterp->sorted[index - 1];
   if (!it) return -1;
-  it = hash_delete(iterp->ht, it->key, al_hash_fn_i(it->key));
+  it = hash_delete(iterp->ht, it->key, it->klen, it->hv);
   if (!it) return -1;
   iterp->to_be_free = it;
   return 0;
@@ -1046,6 +1737,15 @@ item_delete_iter(struct al_hash_iter_t *iterp)
   if (iterp->sorted)
     return del_sorted_iter(iterp);
 
+  if (iterp->ht->h_flag & HASH_FLAG_OPEN) {
+    if (iterp->oindex == 0 || iterp->to_be_free) return -1;
+    struct item *it = OA_ITEM(iterp->ht, iterp->oindex - 1);
+    if (!it->key) return -1;
+    iterp->to_be_free = hash_delete(iterp->ht, it->key, it->klen, it->hv);
+    iterp->oindex = 0;
+    return 0;
+  }
+
   if (!iterp->pplace) return -1;
   struct item *p_it = *iterp->pplace;
   if (!p_it) return -1;
@@ -1269,8 +1969,9 @@ al_list_topk_hash_get(struct al_hash_t *ht, const char *key,
   if (!ht || !key || !v_iterp) return -3;
   if (!(ht->h_flag & HASH_FLAG_LIST)) return -6;
 
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (!it) return -1;
 
   struct al_hash_iter_t *ip = (struct al_hash_iter_t *)
@@ -1578,8 +2279,9 @@ al_pqueue_hash_get(struct al_hash_t *ht, const char *key,
   if ((flag & ~(AL_ITER_AE|AL_ITER_POP|AL_FLAG_NONE)) != 0) return -7;
   if (!(ht->h_flag & HASH_FLAG_PQ)) return -6;
 
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (!it) return -1;
 
   struct al_hash_iter_t *ip = (struct al_hash_iter_t *)
@@ -1729,21 +2431,28 @@ al_is_pqueue_iter(struct al_hash_iter_t *iterp)
 /* either scalar and list ht acceptable */
 
 int
-item_key(struct al_hash_t *ht, const char *key)
+item_key_n(struct al_hash_t *ht, const char *key, size_t klen)
 {
   if (!ht || !key) return -3;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *retp = hash_find(ht, key, hv);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *retp = hash_find(ht, key, klen, hv);
   return retp ? 0 : -1;
 }
 
 int
-item_get(struct al_hash_t *ht, const char *key, value_t *v)
+item_key(struct al_hash_t *ht, const char *key)
+{
+  if (!key) return -3;
+  return item_key_n(ht, key, strlen(key));
+}
+
+int
+item_get_n(struct al_hash_t *ht, const char *key, size_t klen, value_t *v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
 
   if (it) {
     if (v)
@@ -1754,12 +2463,19 @@ item_get(struct al_hash_t *ht, const char *key, value_t *v)
 }
 
 int
-item_get_str(struct al_hash_t *ht, const char *key, cstr_value_t *v)
+item_get(struct al_hash_t *ht, const char *key, value_t *v)
+{
+  if (!key) return -3;
+  return item_get_n(ht, key, strlen(key), v);
+}
+
+int
+item_get_str_n(struct al_hash_t *ht, const char *key, size_t klen, cstr_value_t *v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_STRING)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
 
   if (it) {
     if (v)
@@ -1770,12 +2486,19 @@ item_get_str(struct al_hash_t *ht, const char *key, cstr_value_t *v)
 }
 
 int
-item_get_pointer(struct al_hash_t *ht, const char *key, void **v)
+item_get_str(struct al_hash_t *ht, const char *key, cstr_value_t *v)
+{
+  if (!key) return -3;
+  return item_get_str_n(ht, key, strlen(key), v);
+}
+
+int
+item_get_pointer_n(struct al_hash_t *ht, const char *key, size_t klen, void **v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_POINTER)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
 
   if (it) {
     if (v)
@@ -1786,18 +2509,32 @@ item_get_pointer(struct al_hash_t *ht, const char *key, void **v)
 }
 
 int
-item_set(struct al_hash_t *ht, const char *key, value_t v)
+item_get_pointer(struct al_hash_t *ht, const char *key, void **v)
+{
+  if (!key) return -3;
+  return item_get_pointer_n(ht, key, strlen(key), v);
+}
+
+int
+item_set_n(struct al_hash_t *ht, const char *key, size_t klen, value_t v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     it->u.value = v;
     return 0;
   }
   union item_u u = { .value = v };
-  return hash_v_insert(ht, hv, key, u);
+  return hash_v_insert(ht, hv, key, klen, u);
+}
+
+int
+item_set(struct al_hash_t *ht, const char *key, value_t v)
+{
+  if (!key) return -3;
+  return item_set_n(ht, key, strlen(key), v);
 }
 
 #ifdef ITEM_PV
@@ -1806,8 +2543,9 @@ item_set_pv(struct al_hash_t *ht, const char *key, value_t v, value_t *ret_pv)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     if (ret_pv)
       *ret_pv = it->u.value;
@@ -1815,17 +2553,14 @@ item_set_pv(struct al_hash_t *ht, const char *key, value_t v, value_t *ret_pv)
     return 0;
   }
   union item_u u = { .value = v };
-  return hash_v_insert(ht, hv, key, u);
+  return hash_v_insert(ht, hv, key, klen, u);
 }
 #endif
 
-int
-item_set_str(struct al_hash_t *ht, const char *key, cstr_value_t v)
+static int
+set_str_hv(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv, cstr_value_t v)
 {
-  if (!ht || !key) return -3;
-  if (!(ht->h_flag & HASH_FLAG_STRING)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  struct item *it = hash_find(ht, key, klen, hv);
   cstr_value_t lv = NULL;
   if (v) {
     lv = strdup(v);
@@ -1838,20 +2573,33 @@ item_set_str(struct al_hash_t *ht, const char *key, cstr_value_t v)
     return 0;
   }
   union item_u u = { .cstr = lv };
-  int ret = hash_v_insert(ht, hv, key, u);
+  int ret = hash_v_insert(ht, hv, key, klen, u);
   if (ret < 0)
     free((void *)lv);
   return ret;
 }
 
 int
-item_set_pointer2(struct al_hash_t *ht, const char *key, void *v, unsigned int size, void **ret_v)
+item_set_str_n(struct al_hash_t *ht, const char *key, size_t klen, cstr_value_t v)
+{
+  if (!ht || !key) return -3;
+  if (!(ht->h_flag & HASH_FLAG_STRING)) return -6;
+  return set_str_hv(ht, key, klen, ht->hash_fn(key, klen), v);
+}
+
+int
+item_set_str(struct al_hash_t *ht, const char *key, cstr_value_t v)
+{
+  if (!key) return -3;
+  return item_set_str_n(ht, key, strlen(key), v);
+}
+
+static int
+set_pointer_hv(struct al_hash_t *ht, const char *key, size_t klen, unsigned int hv,
+               void *v, unsigned int size, void **ret_v)
 {
   int ret = 0;
-  if (!ht || !key || !v) return -3;
-  if (!(ht->h_flag & HASH_FLAG_POINTER)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  struct item *it = hash_find(ht, key, klen, hv);
 
   void *ptr;
   if (ht->dup_p) {
@@ -1870,26 +2618,48 @@ item_set_pointer2(struct al_hash_t *ht, const char *key, void *v, unsigned int s
     it->u.ptr = ptr;
   } else {
     union item_u u = { .ptr = ptr };
-    ret = hash_v_insert(ht, hv, key, u);
+    ret = hash_v_insert(ht, hv, key, klen, u);
   }
   if (0 <= ret && ret_v)
     *ret_v = ptr;
   return ret;
 }
 
+int
+item_set_pointer2_n(struct al_hash_t *ht, const char *key, size_t klen, void *v, unsigned int size, void **ret_v)
+{
+  if (!ht || !key || !v) return -3;
+  if (!(ht->h_flag & HASH_FLAG_POINTER)) return -6;
+  return set_pointer_hv(ht, key, klen, ht->hash_fn(key, klen), v, size, ret_v);
+}
+
+int
+item_set_pointer2(struct al_hash_t *ht, const char *key, void *v, unsigned int size, void **ret_v)
+{
+  if (!key) return -3;
+  return item_set_pointer2_n(ht, key, strlen(key), v, size, ret_v);
+}
+
 inline int
 item_set_pointer(struct al_hash_t *ht, const char *key, void *v, unsigned int size)
 {
   return item_set_pointer2(ht, key, v, size, NULL);
 }
 
+int
+item_set_pointer_n(struct al_hash_t *ht, const char *key, size_t klen, void *v, unsigned int size)
+{
+  return item_set_pointer2_n(ht, key, klen, v, size, NULL);
+}
+
 int
 item_replace(struct al_hash_t *ht, const char *key, value_t v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     it->u.value = v;
     return 0;
@@ -1903,8 +2673,9 @@ item_replace_pv(struct al_hash_t *ht, const char *key, value_t v, value_t *ret_p
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     if (ret_pv)
       *ret_pv = it->u.value;
@@ -1920,8 +2691,9 @@ item_replace_str(struct al_hash_t *ht, const char *key, cstr_value_t v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_STRING)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
 
   if (it) {
     cstr_value_t lv = NULL;
@@ -1946,12 +2718,11 @@ item_delete(struct al_hash_t *ht, const char *key)
 #endif
     return -5;
   }
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_delete(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_delete(ht, key, klen, hv);
   if (it) {
-    free_value(ht, it);
-    free((void *)it->key);
-    free((void *)it);
+    free_item(ht, it);
     return 0;
   }
   return -1;
@@ -1969,14 +2740,13 @@ item_delete_pv(struct al_hash_t *ht, const char *key, value_t *ret_pv)
 #endif
     return -5;
   }
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_delete(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_delete(ht, key, klen, hv);
   if (it) {
     if (ret_pv)
       *ret_pv = it->u.value;
-    free_value(ht, it);
-    free((void *)it->key);
-    free((void *)it);
+    free_item(ht, it);
     return 0;
   }
   return -1;
@@ -1988,14 +2758,15 @@ item_unique_id(struct al_hash_t *ht, const char *key, long *id)
 {
   if (!ht || !key || !id) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     *id = it->u.value;
     return 0;
   }
   union item_u u = { .value = ht->unique_id++ };
-  int ret = hash_v_insert(ht, hv, key, u);
+  int ret = hash_v_insert(ht, hv, key, klen, u);
   if (!ret) 
     *id = u.value;
   return ret;
@@ -2009,34 +2780,36 @@ item_unique_id_with_inv(struct al_hash_t *ht, struct al_hash_t *invht, const cha
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
   if (!(invht->h_flag & HASH_FLAG_STRING)) return -6;
 
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     *id = it->u.value;
     return 0;
   }
   union item_u u = { .value = ht->unique_id++ };
-  ret = hash_v_insert(ht, hv, key, u);
+  ret = hash_v_insert(ht, hv, key, klen, u);
 
   if (!ret) {
     cstr_value_t lv = strdup(key);
     if (!lv) {
       ht->unique_id--;
-      hash_delete(ht, key, hv);
+      free_item(ht, hash_delete(ht, key, klen, hv));
       return -2;
     }
 
     char buf[32];
     snprintf(buf, sizeof(buf), "%ld", u.value);
-    unsigned int ihv = al_hash_fn_i(buf);
+    size_t ilen = strlen(buf);
+    unsigned int ihv = invht->hash_fn(buf, ilen);
     union item_u uu = { .cstr = lv };
-    ret = hash_v_insert(invht, ihv, buf, uu);
+    ret = hash_v_insert(invht, ihv, buf, ilen, uu);
     if (!ret) {
       *id = u.value;
     } else {
       free((void *)lv);
       ht->unique_id--;
-      hash_delete(ht, key, hv);
+      free_item(ht, hash_delete(ht, key, klen, hv));
     }
   }
 
@@ -2048,15 +2821,16 @@ item_get_or_set(struct al_hash_t *ht, const char *key, value_t *ret_v, value_t i
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) {
     if (ret_v)
       *ret_v = it->u.value;
     return 0;
   }
   union item_u u = { .value = id };
-  int ret = hash_v_insert(ht, hv, key, u);
+  int ret = hash_v_insert(ht, hv, key, klen, u);
   if (!ret) {
     if (ret_v)
       *ret_v = id;
@@ -2070,8 +2844,9 @@ item_inc(struct al_hash_t *ht, const char *key, value_t off, value_t *ret_v)
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (!it) return -1;
 
   it->u.value += off;
@@ -2085,15 +2860,16 @@ item_inc_init(struct al_hash_t *ht, const char *key, value_t off, value_t *ret_v
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (!it) {
     union item_u u = { .value = off };
 #ifdef INC_INIT_RETURN_ONE
-    int ret = hash_v_insert(ht, hv, key, u);
+    int ret = hash_v_insert(ht, hv, key, klen, u);
     return ret == 0 ? 1 : ret;
 #else
-    return hash_v_insert(ht, hv, key, u);
+    return hash_v_insert(ht, hv, key, klen, u);
 #endif
   }
 
@@ -2108,15 +2884,16 @@ item_inc_init2(struct al_hash_t *ht, const char *key, value_t off, value_t init,
 {
   if (!ht || !key) return -3;
   if (!(ht->h_flag & HASH_FLAG_SCALAR)) return -6;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (!it) {
     union item_u u = { .value = init };
 #ifdef INC_INIT_RETURN_ONE
-    int ret = hash_v_insert(ht, hv, key, u);
+    int ret = hash_v_insert(ht, hv, key, klen, u);
     return ret == 0 ? 1 : ret;
 #else
-    return hash_v_insert(ht, hv, key, u);
+    return hash_v_insert(ht, hv, key, klen, u);
 #endif
   }
 
@@ -2130,8 +2907,9 @@ static int
 add_value_to_pq(struct al_hash_t *ht, const char *key, cstr_value_t v)
 {
   int ret = 0;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) /* found, insert value part to sl */
     return sl_inc_init_n(it->u.skiplist, v, 1, NULL, ht->pq_max_n);
 
@@ -2146,10 +2924,10 @@ add_value_to_pq(struct al_hash_t *ht, const char *key, cstr_value_t v)
   ret = sl_inc_init_n(it->u.skiplist, v, 1, NULL, ht->pq_max_n);
   if (ret < 0) goto free;
 
-  it->key = strdup(key);
+  it->key = key_dup(key, klen);
   if (!it->key) { ret = -2; goto free; }
 
-  ret = hash_insert(ht, hv, key, it);
+  ret = hash_insert(ht, hv, klen, it);
   if (ret < 0) goto free_key;
 
   return 0;
@@ -2167,8 +2945,9 @@ static int
 add_value_to_heap(struct al_hash_t *ht, const char *key, value_t v)
 {
   int ret = 0;
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   if (it) /* found, insert value part to heap */
     return al_insert_heap(it->u.heap, v);
 
@@ -2183,10 +2962,10 @@ add_value_to_heap(struct al_hash_t *ht, const char *key, value_t v)
   ret = al_insert_heap(it->u.heap, v);
   if (ret < 0) goto free;
 
-  it->key = strdup(key);
+  it->key = key_dup(key, klen);
   if (!it->key) { ret = -2; goto free; }
 
-  ret = hash_insert(ht, hv, key, it);
+  ret = hash_insert(ht, hv, klen, it);
   if (ret < 0) goto free_key;
 
   return 0;
@@ -2223,8 +3002,9 @@ add_value_to_list(struct al_hash_t *ht, const char *key, value_t v, cstr_value_t
       vptr = p;
     }
   }
-  unsigned int hv = al_hash_fn_i(key);
-  struct item *it = hash_find(ht, key, hv);
+  size_t klen = strlen(key);
+  unsigned int hv = ht->hash_fn(key, klen);
+  struct item *it = hash_find(ht, key, klen, hv);
   list_t *ndp = NULL;
 
   int ret = -2;
@@ -2271,7 +3051,7 @@ add_value_to_list(struct al_hash_t *ht, const char *key, value_t v, cstr_value_t
   it = (struct item *)malloc(sizeof(struct item));
   if (!it) goto free_ndp;
 
-  it->key = strdup(key);
+  it->key = key_dup(key, klen);
   if (!it->key) goto free_it;
 
   ndp->va_size = LCDR_SIZE_L;
@@ -2285,7 +3065,7 @@ add_value_to_list(struct al_hash_t *ht, const char *key, value_t v, cstr_value_t
 
   it->u.list = ndp;
 
-  ret = hash_insert(ht, hv, key, it);
+  ret = hash_insert(ht, hv, klen, it);
   if (ret < 0) goto free_key;
 
   return 0;
@@ -2349,6 +3129,22 @@ count_chain(al_chain_length_t acl,
   }
 }
 
+/* open addressing, histogram of probe length of entries */
+static void
+count_probe(al_chain_length_t acl, struct al_hash_t *ht)
+{
+  unsigned int i;
+  for (i = 0; i <= ht->hash_mask; i++) {
+    struct oa_slot *sp = &ht->oa_slot[i];
+    if (sp->idx == OA_EMPTY) continue;
+    unsigned int dist = oa_dist(sp, i, ht->hash_mask);
+    if (dist < 10)
+      acl[dist]++;
+    else
+      acl[10]++;
+  }
+}
+
 int
 al_hash_stat(struct al_hash_t *ht,
              struct al_hash_stat_t *statp,
@@ -2366,6 +3162,11 @@ al_hash_stat(struct al_hash_t *ht,
 
   memset((void *)acl, 0, sizeof(al_chain_length_t));
 
+  if (ht->h_flag & HASH_FLAG_OPEN) {
+    count_probe(acl, ht);
+    return 0;
+  }
+
   if (ht->rehashing) {
     count_chain(acl, ht->hash_table_old, ht->rehashing_front,
                 hash_size(ht->hash_bit - 1));
@@ -2423,6 +3224,621 @@ al_set_hash_err_msg_impl(struct al_hash_t *ht, const char *msg)
   return 0;
 }
 
+/*****************************************************************/
+/*
+ * concurrent hash table, lock striped
+ *   keys are spread over 1 << shard_bit tables (shards) by the top bits
+ *   of hash value, the table index uses the low bits.  each shard has
+ *   its own rwlock: lookups take the read lock and run in parallel,
+ *   set/delete take the write lock of one shard only.
+ *   incremental rehashing of a shard is driven by its inserts, i.e.
+ *   under its write lock, and lookups never move entries, so rehashing
+ *   is safe without further care.
+ *   hash value is computed once, out of the lock.
+ */
+struct al_chash_shard {
+  pthread_rwlock_t lock;
+  struct al_hash_t *ht;
+} __attribute__((aligned(64)));  // a shard per cache line
+
+struct al_chash_t {
+  unsigned int shard_bit;
+  unsigned int h_flag;
+  al_hash_fn_t hash_fn;
+  struct al_chash_shard *shard;
+};
+
+#define chash_shard(cht, hv) (&(cht)->shard[(hv) >> (32 - (cht)->shard_bit)])
+
+int
+al_init_chash(int type, int shard_bit, unsigned long n, struct al_chash_t **chtp)
+{
+  if (!chtp) return -3;
+  *chtp = NULL;
+  if ((type & HASH_TYPE_MASK) != HASH_TYPE_SCALAR &&
+      (type & HASH_TYPE_MASK) != HASH_TYPE_STRING &&
+      (type & HASH_TYPE_MASK) != HASH_TYPE_POINTER) return -6;
+
+  if (shard_bit <= 0)
+    shard_bit = AL_DEFAULT_CHASH_SHARD_BIT;
+  if (AL_MAX_CHASH_SHARD_BIT < shard_bit)
+    shard_bit = AL_MAX_CHASH_SHARD_BIT;
+
+  struct al_chash_t *cht = (struct al_chash_t *)calloc(1, sizeof(struct al_chash_t));
+  if (!cht) return -2;
+  unsigned int i, nshard = hash_size(shard_bit);
+  void *mem;
+  if (posix_memalign(&mem, sizeof(struct al_chash_shard),
+                     nshard * sizeof(struct al_chash_shard)) != 0) {
+    free((void *)cht);
+    return -2;
+  }
+  memset(mem, 0, nshard * sizeof(struct al_chash_shard));
+  cht->shard = (struct al_chash_shard *)mem;
+  cht->shard_bit = shard_bit;
+  cht->h_flag = type;
+  cht->hash_fn = al_hash_fn_i;
+
+  for (i = 0; i < nshard; i++) {
+    int ret = al_init_hash_capacity(type, (n >> shard_bit) + 1, &cht->shard[i].ht);
+    if (ret < 0) {
+      al_free_chash(cht);
+      return ret;
+    }
+    pthread_rwlock_init(&cht->shard[i].lock, NULL);
+  }
+  *chtp = cht;
+  return 0;
+}
+
+int
+al_set_chash_fn(struct al_chash_t *cht, al_hash_fn_t fn)
+{
+  if (!cht) return -3;
+  unsigned int i;
+  for (i = 0; i < hash_size(cht->shard_bit); i++) {
+    int ret = al_set_hash_fn(cht->shard[i].ht, fn);
+    if (ret < 0) return ret;
+  }
+  cht->hash_fn = fn ? fn : al_hash_fn_i;
+  return 0;
+}
+
+int
+al_set_pointer_chash_parameter(struct al_chash_t *cht,
+                               int (*dup_p)(void *ptr, unsigned int size, void **ret_v),
+                               void (*free_p)(void *ptr))
+{
+  if (!cht) return -3;
+  unsigned int i;
+  for (i = 0; i < hash_size(cht->shard_bit); i++) {
+    int ret = al_set_pointer_hash_parameter(cht->shard[i].ht, dup_p, free_p, NULL, NULL);
+    if (ret < 0) return ret;
+  }
+  return 0;
+}
+
+int
+al_free_chash(struct al_chash_t *cht)
+{
+  if (!cht) return -3;
+  unsigned int i;
+  for (i = 0; i < hash_size(cht->shard_bit); i++) {
+    if (!cht->shard[i].ht) break;  // al_init_chash() failed here
+    al_free_hash(cht->shard[i].ht);
+    pthread_rwlock_destroy(&cht->shard[i].lock);
+  }
+  free((void *)cht->shard);
+  free((void *)cht);
+  return 0;
+}
+
+int
+al_chash_nkeys(struct al_chash_t *cht, unsigned long *nkeys)
+{
+  if (!cht || !nkeys) return -3;
+  unsigned int i;
+  *nkeys = 0;
+  for (i = 0; i < hash_size(cht->shard_bit); i++) {
+    struct al_chash_shard *sp = &cht->shard[i];
+    pthread_rwlock_rdlock(&sp->lock);
+    *nkeys += sp->ht->n_entries + sp->ht->n_entries_old;
+    pthread_rwlock_unlock(&sp->lock);
+  }
+  return 0;
+}
+
+int
+al_chash_stat(struct al_chash_t *cht, struct al_hash_stat_t *statp, al_chain_length_t acl)
+{
+  if (!cht || !statp) return -3;
+  unsigned int i, j;
+  al_chain_length_t sacl;
+  memset((void *)statp, 0, sizeof(struct al_hash_stat_t));
+  if (acl)
+    memset((void *)acl, 0, sizeof(al_chain_length_t));
+
+  for (i = 0; i < hash_size(cht->shard_bit); i++) {
+    struct al_chash_shard *sp = &cht->shard[i];
+    struct al_hash_stat_t st;
+    pthread_rwlock_rdlock(&sp->lock);
+    al_hash_stat(sp->ht, &st, acl ? sacl : NULL);
+    pthread_rwlock_unlock(&sp->lock);
+
+    if (statp->al_hash_bit < st.al_hash_bit)
+      statp->al_hash_bit = st.al_hash_bit;
+    statp->al_n_rehashing += st.al_n_rehashing;
+    statp->al_n_entries += st.al_n_entries;
+    statp->al_n_entries_old += st.al_n_entries_old;
+    statp->al_n_cancel_rehashing += st.al_n_cancel_rehashing;
+    if (acl) {
+      for (j = 0; j < sizeof(al_chain_length_t) / sizeof(acl[0]); j++)
+        acl[j] += sacl[j];
+    }
+  }
+  return 0;
+}
+
+int
+citem_key_n(struct al_chash_t *cht, const char *key, size_t klen)
+{
+  if (!cht || !key) return -3;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+
+  pthread_rwlock_rdlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  pthread_rwlock_unlock(&sp->lock);
+  return it ? 0 : -1;
+}
+
+int
+citem_get_n(struct al_chash_t *cht, const char *key, size_t klen, value_t *v)
+{
+  if (!cht || !key) return -3;
+  if (!(cht->h_flag & HASH_FLAG_SCALAR)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+  int ret = -1;
+
+  pthread_rwlock_rdlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  if (it) {
+    if (v)
+      *v = it->u.value;
+    ret = 0;
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+/* value is copied to buf, it may be replaced or deleted by other threads */
+int
+citem_get_str_n(struct al_chash_t *cht, const char *key, size_t klen, char *buf, size_t size)
+{
+  if (!cht || !key || !buf || !size) return -3;
+  if (!(cht->h_flag & HASH_FLAG_STRING)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+  int ret = -1;
+
+  pthread_rwlock_rdlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  if (it) {
+    const char *cp = it->u.cstr ? it->u.cstr : "";
+    size_t len = strlen(cp);
+    ret = 0;
+    if (size <= len) {
+      len = size - 1;
+      ret = -8;
+    }
+    memcpy(buf, cp, len);
+    buf[len] = '\0';
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_get_pointer_n(struct al_chash_t *cht, const char *key, size_t klen, void **v)
+{
+  if (!cht || !key) return -3;
+  if (!(cht->h_flag & HASH_FLAG_POINTER)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+  int ret = -1;
+
+  pthread_rwlock_rdlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  if (it) {
+    if (v)
+      *v = it->u.ptr;
+    ret = 0;
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_set_n(struct al_chash_t *cht, const char *key, size_t klen, value_t v)
+{
+  if (!cht || !key) return -3;
+  if (!(cht->h_flag & HASH_FLAG_SCALAR)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+  int ret = 0;
+
+  pthread_rwlock_wrlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  if (it) {
+    it->u.value = v;
+  } else {
+    union item_u u = { .value = v };
+    ret = hash_v_insert(sp->ht, hv, key, klen, u);
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_set_str_n(struct al_chash_t *cht, const char *key, size_t klen, cstr_value_t v)
+{
+  if (!cht || !key) return -3;
+  if (!(cht->h_flag & HASH_FLAG_STRING)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+
+  pthread_rwlock_wrlock(&sp->lock);
+  int ret = set_str_hv(sp->ht, key, klen, hv, v);
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_set_pointer_n(struct al_chash_t *cht, const char *key, size_t klen,
+                    void *v, unsigned int size, void **ret_v)
+{
+  if (!cht || !key || !v) return -3;
+  if (!(cht->h_flag & HASH_FLAG_POINTER)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+
+  pthread_rwlock_wrlock(&sp->lock);
+  int ret = set_pointer_hv(sp->ht, key, klen, hv, v, size, ret_v);
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_inc_init_n(struct al_chash_t *cht, const char *key, size_t klen, value_t off, value_t *ret_v)
+{
+  if (!cht || !key) return -3;
+  if (!(cht->h_flag & HASH_FLAG_SCALAR)) return -6;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+  int ret = 0;
+
+  pthread_rwlock_wrlock(&sp->lock);
+  struct item *it = hash_find(sp->ht, key, klen, hv);
+  if (it) {
+    it->u.value += off;
+    if (ret_v)
+      *ret_v = it->u.value;
+  } else {
+    union item_u u = { .value = off };
+    ret = hash_v_insert(sp->ht, hv, key, klen, u);
+#ifdef INC_INIT_RETURN_ONE
+    if (ret == 0) ret = 1;
+#endif
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+int
+citem_delete_n(struct al_chash_t *cht, const char *key, size_t klen)
+{
+  if (!cht || !key) return -3;
+  unsigned int hv = cht->hash_fn(key, klen);
+  struct al_chash_shard *sp = chash_shard(cht, hv);
+
+  int ret = -1;
+
+  pthread_rwlock_wrlock(&sp->lock);
+  struct item *it = hash_delete(sp->ht, key, klen, hv);
+  if (it) {
+    free_item(sp->ht, it);
+    ret = 0;
+  }
+  pthread_rwlock_unlock(&sp->lock);
+  return ret;
+}
+
+/*****************************************************************/
+/*
+ * snapshot of scalar/string hash table, used read only by mmap
+ *
+ * file layout, offsets are from top of file, native byte order
+ *   struct snap_head
+ *   struct oa_slot  slot[1 << bit]  Robin Hood, same as HASH_TYPE_OPEN
+ *   struct snap_ent ent[n]          dictionary order of key
+ *   key and value strings, '\0' terminated
+ * loading checks the header only, no per entry work.
+ */
+#define SNAP_MAGIC   "alhash\0"  // 8 bytes with '\0'
+#define SNAP_VERSION 1
+#define SNAP_ORDER   0x01020304  // byte order check
+#define SNAP_FN_I    0           // al_hash_fn_i
+#define SNAP_FN_WORD 1           // al_hash_fn_word
+
+struct snap_head {
+  char magic[8];
+  uint32_t version;
+  uint32_t order;
+  uint32_t type;      // HASH_TYPE_SCALAR or HASH_TYPE_STRING
+  uint32_t fn;        // SNAP_FN_xxx
+  uint32_t bit;
+  uint32_t pad;
+  uint64_t n;         // number of entries
+  uint64_t slot_off;
+  uint64_t ent_off;
+  uint64_t str_off;
+  uint64_t size;      // file size
+};
+
+struct snap_ent {
+  uint64_t koff;
+  uint32_t klen;
+  uint32_t pad;
+  union {
+    int64_t value;
+    uint64_t voff;    // string, 0: NULL
+  } u;
+};
+
+struct al_hash_mmap_t {
+  const char *base;
+  size_t size;
+  const struct snap_head *head;
+  const struct oa_slot *slot;
+  const struct snap_ent *ent;
+  unsigned int mask;
+  al_hash_fn_t hash_fn;
+};
+
+int
+al_hash_save(struct al_hash_t *ht, int fd)
+{
+  if (!ht || fd < 0) return -3;
+  unsigned int type = ht->h_flag & HASH_TYPE_MASK;
+  if (type != HASH_FLAG_SCALAR && type != HASH_FLAG_STRING) return -6;
+  uint32_t fn;
+  if (ht->hash_fn == al_hash_fn_i) fn = SNAP_FN_I;
+  else if (ht->hash_fn == al_hash_fn_word) fn = SNAP_FN_WORD;
+  else return -6;
+
+  unsigned long i, n = ht->n_entries + ht->n_entries_old;
+  struct item **it_array = (struct item **)malloc(sizeof(struct item *) * (n + 1));
+  if (!it_array) return -2;
+  if (collect_items(ht, it_array) < 0) {
+    free((void *)it_array);
+    return -99;
+  }
+  qsort((void *)it_array, n, sizeof(struct item *), it_cmp);
+
+  int bit = capacity_bit(1, n);
+  size_t nslot = hash_size(bit);
+  size_t str_size = 0;
+  for (i = 0; i < n; i++) {
+    str_size += it_array[i]->klen + 1;
+    if (type == HASH_FLAG_STRING && it_array[i]->u.cstr)
+      str_size += strlen(it_array[i]->u.cstr) + 1;
+  }
+
+  struct snap_head head;
+  memset((void *)&head, 0, sizeof(head));
+  memcpy(head.magic, SNAP_MAGIC, sizeof(head.magic));
+  head.version = SNAP_VERSION;
+  head.order = SNAP_ORDER;
+  head.type = type;
+  head.fn = fn;
+  head.bit = bit;
+  head.n = n;
+  head.slot_off = sizeof(head);
+  head.ent_off = head.slot_off + nslot * sizeof(struct oa_slot);
+  head.str_off = head.ent_off + n * sizeof(struct snap_ent);
+  head.size = head.str_off + str_size;
+
+  char *buf = (char *)calloc(1, head.size);
+  if (!buf) {
+    free((void *)it_array);
+    return -2;
+  }
+  memcpy(buf, &head, sizeof(head));
+  struct oa_slot *slot = (struct oa_slot *)(buf + head.slot_off);
+  struct snap_ent *ent = (struct snap_ent *)(buf + head.ent_off);
+  uint64_t so = head.str_off;
+  for (i = 0; i < n; i++) {
+    struct item *it = it_array[i];
+    ent[i].koff = so;
+    ent[i].klen = it->klen;
+    memcpy(buf + so, it->key, it->klen + 1);
+    so += it->klen + 1;
+    if (type == HASH_FLAG_SCALAR) {
+      ent[i].u.value = it->u.value;
+    } else if (it->u.cstr) {
+      size_t vlen = strlen(it->u.cstr);
+      ent[i].u.voff = so;
+      memcpy(buf + so, it->u.cstr, vlen + 1);
+      so += vlen + 1;
+    }
+    struct oa_slot s = {it->hv, (uint32_t)(i + 1)};
+    oa_place(slot, nslot - 1, s);
+  }
+  free((void *)it_array);
+
+  int ret = 0;
+  size_t off = 0;
+  while (off < head.size) {
+    ssize_t w = write(fd, buf + off, head.size - off);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      ret = -11;
+      break;
+    }
+    off += w;
+  }
+  free((void *)buf);
+  return ret;
+}
+
+int
+al_hash_load_mmap(const char *path, struct al_hash_mmap_t **mpp)
+{
+  if (!path || !mpp) return -3;
+  *mpp = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return -11;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -11;
+  }
+  if ((size_t)st.st_size < sizeof(struct snap_head)) {
+    close(fd);
+    return -12;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return -11;
+
+  const struct snap_head *hp = (const struct snap_head *)base;
+  uint64_t nslot = AL_MAX_HASH_BIT < hp->bit ? 0 : hash_size(hp->bit);
+  if (memcmp(hp->magic, SNAP_MAGIC, sizeof(hp->magic)) != 0 ||
+      hp->version != SNAP_VERSION || hp->order != SNAP_ORDER ||
+      (hp->type != HASH_FLAG_SCALAR && hp->type != HASH_FLAG_STRING) ||
+      (hp->fn != SNAP_FN_I && hp->fn != SNAP_FN_WORD) ||
+      nslot == 0 || nslot <= hp->n || hp->size != (uint64_t)st.st_size ||
+      hp->slot_off != sizeof(struct snap_head) ||
+      hp->ent_off != hp->slot_off + nslot * sizeof(struct oa_slot) ||
+      hp->str_off != hp->ent_off + hp->n * sizeof(struct snap_ent) ||
+      hp->size < hp->str_off) {
+    munmap(base, st.st_size);
+    return -12;
+  }
+
+  struct al_hash_mmap_t *mp = (struct al_hash_mmap_t *)malloc(sizeof(struct al_hash_mmap_t));
+  if (!mp) {
+    munmap(base, st.st_size);
+    return -2;
+  }
+  mp->base = (const char *)base;
+  mp->size = st.st_size;
+  mp->head = hp;
+  mp->slot = (const struct oa_slot *)(mp->base + hp->slot_off);
+  mp->ent = (const struct snap_ent *)(mp->base + hp->ent_off);
+  mp->mask = nslot - 1;
+  mp->hash_fn = hp->fn == SNAP_FN_WORD ? al_hash_fn_word : al_hash_fn_i;
+  *mpp = mp;
+  return 0;
+}
+
+int
+al_hash_unmap(struct al_hash_mmap_t *mp)
+{
+  if (!mp) return -3;
+  munmap((void *)mp->base, mp->size);
+  free((void *)mp);
+  return 0;
+}
+
+int
+al_hash_mmap_nkeys(struct al_hash_mmap_t *mp, unsigned long *nkeys)
+{
+  if (!mp || !nkeys) return -3;
+  *nkeys = mp->head->n;
+  return 0;
+}
+
+static const struct snap_ent *
+snap_find(struct al_hash_mmap_t *mp, const char *key, size_t klen)
+{
+  unsigned int hv = mp->hash_fn(key, klen);
+  unsigned int i = hv & mp->mask;
+  unsigned int d = 0;
+  const struct oa_slot *sp;
+
+  while ((sp = &mp->slot[i])->idx != OA_EMPTY &&
+         d <= oa_dist(sp, i, mp->mask)) {
+    if (sp->tag == hv) {
+      const struct snap_ent *ep = &mp->ent[sp->idx - 1];
+      if (ep->klen == klen && memcmp(key, mp->base + ep->koff, klen) == 0)
+        return ep;
+    }
+    i = (i + 1) & mp->mask;
+    d++;
+  }
+  return NULL;
+}
+
+int
+mitem_key_n(struct al_hash_mmap_t *mp, const char *key, size_t klen)
+{
+  if (!mp || !key) return -3;
+  return snap_find(mp, key, klen) ? 0 : -1;
+}
+
+int
+mitem_get_n(struct al_hash_mmap_t *mp, const char *key, size_t klen, value_t *v)
+{
+  if (!mp || !key) return -3;
+  if (mp->head->type != HASH_FLAG_SCALAR) return -6;
+  const struct snap_ent *ep = snap_find(mp, key, klen);
+  if (!ep) return -1;
+  if (v)
+    *v = ep->u.value;
+  return 0;
+}
+
+int
+mitem_get_str_n(struct al_hash_mmap_t *mp, const char *key, size_t klen, cstr_value_t *v)
+{
+  if (!mp || !key) return -3;
+  if (mp->head->type != HASH_FLAG_STRING) return -6;
+  const struct snap_ent *ep = snap_find(mp, key, klen);
+  if (!ep) return -1;
+  if (v)
+    *v = ep->u.voff ? mp->base + ep->u.voff : NULL;
+  return 0;
+}
+
+int
+mitem_at(struct al_hash_mmap_t *mp, unsigned long i, const char **key, value_t *v)
+{
+  if (!mp) return -3;
+  if (mp->head->type != HASH_FLAG_SCALAR) return -6;
+  if (mp->head->n <= i) return -1;
+  if (key)
+    *key = mp->base + mp->ent[i].koff;
+  if (v)
+    *v = mp->ent[i].u.value;
+  return 0;
+}
+
+int
+mitem_at_str(struct al_hash_mmap_t *mp, unsigned long i, const char **key, cstr_value_t *v)
+{
+  if (!mp) return -3;
+  if (mp->head->type != HASH_FLAG_STRING) return -6;
+  if (mp->head->n <= i) return -1;
+  if (key)
+    *key = mp->base + mp->ent[i].koff;
+  if (v)
+    *v = mp->ent[i].u.voff ? mp->base + mp->ent[i].u.voff : NULL;
+  return 0;
+}
+
 /*
  *  string priority queue, implemented by skiplist
  */
@@ -2690,7 +4106,7 @@ static int
 get_level(pq_key_t key)
 {
   int level = 1;
-  uint32_t r = al_hash_fn_i(key);
+  uint32_t r = al_hash_fn_i(key, strlen(key));
   while (r & 1) { // "r&1": p is 0.5,  "(r&3)==3": p is 0.25, "(r&3)!=0": p is 0.75
     level++;
     r >>= 1;
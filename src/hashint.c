@@ -6,101 +6,234 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "itpl2dirtree.h"
 
+struct _tstr ttIdStr[_tt_last + 1] = {
+  /* tag name */
+  {t_key,     "key"},
+  {t_integer, "integer"},
+  {t_string,  "string"},
+  {t_date,    "date"},
+  {t_data,    "data"},
+  {t_true,    "true"},
+  {t_false,   "false"},
+
+  {t_plist,   "plist"},
+  {t_dict,    "dict"},
+  {t_array,   "array"},
+  {t_top,     "top"},
+
+  {t_val,     "val"},
+  {t_bool,    "bool"},
+  {t_none,    "none"},
+
+  /* key name */
+  {t_tracks,     "Tracks"},       // dict
+  {t_kind,       "Kind"},         // string
+  {t_location,   "Location"},     // string
+  {t_album,      "Album"},        // string
+  {t_name,       "Name"},         // string
+  {t_artist,     "Artist"},       // string
+  {t_comments,   "Comments"},     // string
+  {t_diskn,      "Disc Number"},  // integer
+  {t_diskc,      "Disc Count"},   // integer
+  {t_trackn,     "Track Number"}, // integer
+  {t_trackc,     "Track Count"},  // integer
+  {t_trackid,    "Track ID"},     // integer
+  {t_totaltime,  "Total Time"},   // integer
+  {t_samplerate, "Sample Rate"},  // integer
+  {t_disabled,   "Disabled"},     // bool
+
+  {t_master,   "Master"},       // bool
+  {t_dkind,    "Distinguished Kind"},     // integer
+  {t_folder,   "Folder"},       // bool
+  {t_pid,      "Playlist Persistent ID"}, // string
+  {t_ppid,     "Parent Persistent ID"},   // string
+
+  /* key contents */
+  {t_playlists, "Playlists"},          // array
+  {t_playlistitems, "Playlist Items"}, // array
+
+  {_tt_last,   ""},
+};
+const char *ttStr[_tt_last + 1];
+
+/* compare rest of s with literal str, s and str have same length */
+#define TT_IS(str, id) (memcmp(s + 1, (str) + 1, sizeof(str) - 2) == 0 ? (id) : -1)
+
+/*
+ * tag/key string -> enum _tt, dispatch by length and first char
+ * return -1, if s is not in ttIdStr[]
+ * keep in sync with ttIdStr[], init_tthash() checks it
+ */
+int
+tt_lookup(const char *s)
+{
+  switch (strlen(s)) {
+  case 3:
+    switch (s[0]) {
+    case 'k': return TT_IS("key", t_key);
+    case 't': return TT_IS("top", t_top);
+    case 'v': return TT_IS("val", t_val);
+    }
+    break;
+  case 4:
+    switch (s[0]) {
+    case 'd':
+      if (s[1] == 'i') return TT_IS("dict", t_dict);
+      if (s[3] == 'e') return TT_IS("date", t_date);
+      return TT_IS("data", t_data);
+    case 't': return TT_IS("true", t_true);
+    case 'b': return TT_IS("bool", t_bool);
+    case 'n': return TT_IS("none", t_none);
+    case 'K': return TT_IS("Kind", t_kind);
+    case 'N': return TT_IS("Name", t_name);
+    }
+    break;
+  case 5:
+    switch (s[0]) {
+    case 'f': return TT_IS("false", t_false);
+    case 'p': return TT_IS("plist", t_plist);
+    case 'a': return TT_IS("array", t_array);
+    case 'A': return TT_IS("Album", t_album);
+    }
+    break;
+  case 6:
+    switch (s[0]) {
+    case 's': return TT_IS("string", t_string);
+    case 'T': return TT_IS("Tracks", t_tracks);
+    case 'A': return TT_IS("Artist", t_artist);
+    case 'M': return TT_IS("Master", t_master);
+    case 'F': return TT_IS("Folder", t_folder);
+    }
+    break;
+  case 7:
+    if (s[0] == 'i') return TT_IS("integer", t_integer);
+    break;
+  case 8:
+    switch (s[0]) {
+    case 'L': return TT_IS("Location", t_location);
+    case 'C': return TT_IS("Comments", t_comments);
+    case 'T': return TT_IS("Track ID", t_trackid);
+    case 'D': return TT_IS("Disabled", t_disabled);
+    }
+    break;
+  case 9:
+    if (s[0] == 'P') return TT_IS("Playlists", t_playlists);
+    break;
+  case 10:
+    switch (s[0]) {
+    case 'D': return TT_IS("Disc Count", t_diskc);
+    case 'T': return TT_IS("Total Time", t_totaltime);
+    }
+    break;
+  case 11:
+    switch (s[0]) {
+    case 'D': return TT_IS("Disc Number", t_diskn);
+    case 'T': return TT_IS("Track Count", t_trackc);
+    case 'S': return TT_IS("Sample Rate", t_samplerate);
+    }
+    break;
+  case 12:
+    if (s[0] == 'T') return TT_IS("Track Number", t_trackn);
+    break;
+  case 14:
+    if (s[0] == 'P') return TT_IS("Playlist Items", t_playlistitems);
+    break;
+  case 18:
+    if (s[0] == 'D') return TT_IS("Distinguished Kind", t_dkind);
+    break;
+  case 20:
+    if (s[0] == 'P') return TT_IS("Parent Persistent ID", t_ppid);
+    break;
+  case 22:
+    if (s[0] == 'P') return TT_IS("Playlist Persistent ID", t_pid);
+    break;
+  }
+  return -1;
+}
+
 void
 init_tthash()
 {
-  ttHash = get_scalar_hash();
-  al_set_hash_err_msg(ttHash, "ttHash:");
   enum _tt tidx = 0;
   for (; tidx < _tt_last; ++tidx) {
     enum _tt id = ttIdStr[tidx].id;
     if (id == _tt_last) break;
-    int ret = item_set(ttHash, ttIdStr[tidx].name, id);
-    if (ret != 0) fprintf(stderr, "ttHash add %d\n", ret);
+    if (tt_lookup(ttIdStr[tidx].name) != id)
+      fprintf(stderr, "tt_lookup mismatch '%s'\n", ttIdStr[tidx].name);
     ttStr[id] = ttIdStr[tidx].name;
   }
 }
 
-struct al_hash_t *
-get_scalar_hash()
+/*
+ * open addressing table with al_hash_fn_word,
+ * sized for n entries, n == 0: AL_DEFAULT_HASH_BIT
+ */
+static struct al_hash_t *
+get_hash(int type, unsigned long n, const char *name)
 {
   struct al_hash_t *hp = NULL;
-  int ret = al_init_hash(HASH_TYPE_SCALAR, AL_DEFAULT_HASH_BIT, &hp);
+  int ret = al_init_hash_capacity(type|HASH_TYPE_OPEN, n, &hp);
 
   if (ret < 0) {
-    fprintf(stderr, "init scalar hash %d\n", ret);
+    fprintf(stderr, "init %s hash %d\n", name, ret);
     return NULL;
   }
+  al_set_hash_fn(hp, al_hash_fn_word);
   return hp;
 }
 
 struct al_hash_t *
-get_string_hash()
+get_scalar_hash_capacity(unsigned long n)
 {
-  struct al_hash_t *hp = NULL;
-  int ret = al_init_hash(HASH_TYPE_STRING, AL_DEFAULT_HASH_BIT, &hp);
-
-  if (ret < 0) {
-    fprintf(stderr, "init string hash %d\n", ret);
-    return NULL;
-  }
-  return hp;
+  return get_hash(HASH_TYPE_SCALAR, n, "scalar");
 }
 
 struct al_hash_t *
-get_pointer_hash()
+get_string_hash_capacity(unsigned long n)
 {
-  struct al_hash_t *hp = NULL;
-  int ret = al_init_hash(HASH_TYPE_POINTER, AL_DEFAULT_HASH_BIT, &hp);
+  return get_hash(HASH_TYPE_STRING, n, "string");
+}
 
-  if (ret < 0) {
-    fprintf(stderr, "init pointer hash %d\n", ret);
-    return NULL;
-  }
-  return hp;
+struct al_hash_t *
+get_pointer_hash_capacity(unsigned long n)
+{
+  return get_hash(HASH_TYPE_POINTER, n, "pointer");
 }
 
-void
-print_count(struct al_hash_t *ht_count)
+struct al_hash_t *
+get_scalar_hash()
 {
-  struct al_hash_iter_t *itr;
-  const char *ikey;
-  value_t v;
+  return get_scalar_hash_capacity(0);
+}
 
-  int ret = al_hash_iter_init(ht_count, &itr, AL_SORT_COUNTER_DIC|AL_SORT_VALUE|AL_ITER_AE);
-  if (ret < 0)
-    fprintf(stderr, "itr init %d\n", ret);
+struct al_hash_t *
+get_string_hash()
+{
+  return get_string_hash_capacity(0);
+}
 
-  while (0 <= (ret = al_hash_iter(itr, &ikey, &v))) {
-      printf("%ld\t%s\n", v, ikey);
-  }
-  if (ret == 0) { // invoke _end() manually
-    al_hash_iter_end(itr);
-  }
+struct al_hash_t *
+get_pointer_hash()
+{
+  return get_pointer_hash_capacity(0);
 }
 
 void
-print_ntrack(struct al_hash_t *hp, struct al_hash_t *thp)
+print_count(struct al_hash_t *ht_count)
 {
   struct al_hash_iter_t *itr;
   const char *ikey;
   value_t v;
 
-  int ret = al_hash_iter_init(hp, &itr, AL_SORT_DIC|AL_ITER_AE);
-  // int ret = al_hash_iter_init(hp, &itr, AL_ITER_AE);
+  int ret = al_hash_iter_init(ht_count, &itr, AL_SORT_COUNTER_DIC|AL_SORT_VALUE|AL_ITER_AE);
   if (ret < 0)
     fprintf(stderr, "itr init %d\n", ret);
 
   while (0 <= (ret = al_hash_iter(itr, &ikey, &v))) {
-    if (v == 1) {
-      struct _track *rp;
-      int ret = item_get_pointer(thp, ikey, (void *)&rp);
-      if (ret != 0) fprintf(stderr, "item_get_pointer trackHash ret %d\n", ret);
-
-      fprintf(stderr, "track %s %s %s %s\n", ikey, rp->artist, rp->name, rp->album);
-    }
+      printf("%ld\t%s\n", v, ikey);
   }
   if (ret == 0) { // invoke _end() manually
     al_hash_iter_end(itr);
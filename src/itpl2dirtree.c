@@ -12,10 +12,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <sys/errno.h>
 #include <dirent.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <expat.h>
 #include "itpl2dirtree.h"
 
@@ -26,75 +28,42 @@ int o_check = 0;     // show track not in playlist
 int o_verbose = 0;
 int o_debug = 0;
 char *o_path = "";
+size_t o_pathlen = 0; // strlen(o_path)
 char *o_rmprefix = "";
 int org_rmprefixlen = 0;
 int rmprefixlen = 0;
 int checkrm = 0;
 char *o_pldir = "playlist";
+char *o_file = NULL;  // -f, XML file read via mmap instead of stdin
+int o_jobs = 0;       // -j, number of link emission threads
+int o_uring = 0;      // -u, io_uring backend for link emission
+char *o_state = NULL; // -s, state file for incremental re-sync
+int o_stats = 0;      // --stats, phase timing and counters
+int o_fulltrack = 0;  // -c/-d, keep all fields of a track, not only loc and flags
+int o_pthreads = 0;   // -t, number of threads parsing the Tracks dict (-f)
+int o_scan = 0;       // -x, built-in plist scanner instead of expat
 
 /* #define COUNT */
 
-struct _tstr ttIdStr[_tt_last + 1] = {
-  /* tag name */
-  {t_key,     "key"},
-  {t_integer, "integer"},
-  {t_string,  "string"},
-  {t_date,    "date"},
-  {t_data,    "data"},
-  {t_true,    "true"},
-  {t_false,   "false"},
-
-  {t_plist,   "plist"},
-  {t_dict,    "dict"},
-  {t_array,   "array"},
-  {t_top,     "top"},
-
-  {t_val,     "val"},
-  {t_bool,    "bool"},
-  {t_none,    "none"},
-
-  /* key name */
-  {t_tracks,     "Tracks"},       // dict
-  {t_kind,       "Kind"},         // string
-  {t_location,   "Location"},     // string
-  {t_album,      "Album"},        // string
-  {t_name,       "Name"},         // string
-  {t_artist,     "Artist"},       // string
-  {t_comments,   "Comments"},     // string
-  {t_diskn,      "Disc Number"},  // integer
-  {t_diskc,      "Disc Count"},   // integer
-  {t_trackn,     "Track Number"}, // integer
-  {t_trackc,     "Track Count"},  // integer
-  {t_trackid,    "Track ID"},     // integer
-  {t_totaltime,  "Total Time"},   // integer
-  {t_samplerate, "Sample Rate"},  // integer
-  {t_disabled,   "Disabled"},     // bool
-
-  {t_master,   "Master"},       // bool
-  {t_dkind,    "Distinguished Kind"},     // integer
-  {t_folder,   "Folder"},       // bool
-  {t_pid,      "Playlist Persistent ID"}, // string
-  {t_ppid,     "Parent Persistent ID"},   // string
-
-  /* key contents */
-  {t_playlists, "Playlists"},          // array
-  {t_playlistitems, "Playlist Items"}, // array
-
-  {_tt_last,   ""},
-};
-const char *ttStr[_tt_last + 1];
-
-struct al_hash_t *ttHash;     // tag/key string -> enum _tt
-struct al_hash_t *trackHash;  // Track Id str   -> struct _track *
-struct al_hash_t *ntrackHash; // Track Id str   -> count
 struct al_hash_t *folderHash; // folder pid -> name
-struct al_hash_t *realPathHash; // folder pid -> name
-
-// state
-int st_tracks = 0;    /* 0: no track, 1: key is tracks, 2: get track elements */
-int st_playlists = 0; /* 0: no pl,    1: playlists,  2: playlist items */
+struct al_hash_t *dirIndexHash;   // dir/case folded name -> real path
+struct al_hash_t *dirScannedHash; // dir -> 1, dir is read into dirIndexHash
+pthread_mutex_t dirCacheLock = PTHREAD_MUTEX_INITIALIZER; // dir*Hash, -j workers
 
 struct _ud ud;   // user data for expat call back
+struct _scan scan; // -x, scanner feeding ud
+struct _arena trackArena; // records and strings of track table (tracktab.c)
+struct _arena targetArena; // rpath of track records, by target_store()
+pthread_mutex_t targetLock = PTHREAD_MUTEX_INITIALIZER; // targetArena, -j workers
+
+/* jobs of current playlist, held until its digest is known (-s) */
+struct _pending {
+  uint64_t digest;
+  int n;        // number of jobs
+  int size;     // allocated size of paths[], 2 entries per job
+  char **paths; // path1, path2 pairs
+  struct _trec **recs; // track of each job, size / 2 entries
+} pending;
 
 void
 dump(struct _ud *ud, const char *msg0, const char *msg1)
@@ -110,6 +79,72 @@ deesc2(const char *cp) {
   return (hexint(cp[0]) << 4) | hexint(cp[1]);
 }
 
+/*
+ * %XY -> char(0xXY) of s[0..len) to dst, copy runs between '%' with
+ * memcpy.  dst has len + 1 bytes at least.  return length of dst
+ */
+static size_t
+url_decode(char *dst, const char *s, size_t len)
+{
+  char *dp = dst;
+  const char *ep = s + len;
+
+  while (s < ep) {
+    const char *pp = (const char *)memchr(s, '%', ep - s);
+    if (!pp) pp = ep;
+    memcpy(dp, s, pp - s);
+    dp += pp - s;
+    if (ep - pp < 3) {  // no '%', or '%' without two digits
+      memcpy(dp, pp, ep - pp);
+      dp += ep - pp;
+      break;
+    }
+    *dp++ = deesc2(pp + 1);
+    s = pp + 3;
+  }
+  *dp = '\0';
+  return dp - dst;
+}
+
+/*
+ * Location URL -> o_path/decoded Location without -i prefix,
+ * the link contents of every playlist item of the track, in arena ap
+ * Location not under the prefix (stream URL, etc) is kept as is and
+ * *rawp is set, command() reports it when a playlist item uses it
+ */
+static char *
+track_path(struct _arena *ap, const char *loc, size_t len, int *rawp)
+{
+  char buf[BUFSIZE];
+  size_t pathlen = o_pathlen;
+
+  if (len < (size_t)rmprefixlen || strncmp(loc, o_rmprefix, org_rmprefixlen) != 0) {
+    *rawp = 1;
+    return arena_strdup(ap, loc);
+  }
+
+  len -= rmprefixlen;
+  char *dp = buf;
+  if (BUFSIZE <= pathlen + 1 + len) {  // rare, decode in heap and truncate
+    dp = (char *)malloc(pathlen + 1 + len + 1);
+    if (!dp) {
+      fprintf(stderr, "malloc failed\n");
+      exit(1);
+    }
+  }
+  memcpy(dp, o_path, pathlen);
+  dp[pathlen] = '/';
+  size_t n = pathlen + 1 + url_decode(dp + pathlen + 1, loc + rmprefixlen, len);
+  if (BUFSIZE <= n) {
+    n = BUFSIZE - 1;
+    dp[n] = '\0';
+  }
+  char *ret = (char *)arena_alloc(ap, n + 1);
+  memcpy(ret, dp, n + 1);
+  if (dp != buf) free(dp);
+  return ret;
+}
+
 int
 numberp(const char *cp)
 {
@@ -157,86 +192,194 @@ clear_track(struct _track *tp) {
   if (tp->comments)  { free(tp->comments); tp->comments = NULL; }
   if (tp->album)     { free(tp->album);    tp->album    = NULL; }
   if (tp->loc)       { free(tp->loc);      tp->loc      = NULL; }
-  if (tp->trackid)   { free(tp->trackid);  tp->trackid  = NULL; }
+  tp->trackid = 0;
   if (tp->pid)       { free(tp->pid);      tp->pid      = NULL; }
   if (tp->ppid)      { free(tp->ppid);     tp->ppid     = NULL; }
 }
 
-void
-clear_track_ent(void *tp) {
-  clear_track((struct _track *)tp);
-  free(tp);
-}
-
-void dir(const char *name)
+/*
+ * return 1 if directory is created, 0 if it already exists (or error)
+ */
+int dir(const char *name)
 {
   char buf[BUFSIZE];
 
   if (o_dry) {
     if (o_verbose)
       fprintf(stderr, "dry: mkdir %s/%s\n", o_pldir, name);
-    return;
+    return 0;
   }
 
   snprintf(buf, sizeof(buf), "%s/%s", o_pldir, name);
-  struct stat st;
-  if (stat(o_pldir, &st) < 0) {
-    mkdir(o_pldir, 0777);
+  int rfd = pldir_rootfd();
+  if ((rfd < 0 ? mkdir(buf, 0777) : mkdirat(rfd, name, 0777)) < 0) {
+    if (errno != EEXIST) {
+      fprintf(stderr, "mkdir failed %d buf '%s'\n", errno, buf);
+      perror("  mkdir");
+    }
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * remove symbolic links in a playlist directory, before it is rebuilt
+ */
+void
+clean_dir(const char *name)
+{
+  char buf[BUFSIZE];
+  snprintf(buf, sizeof(buf), "%s/%s", o_pldir, name);
+
+  DIR *dirp = opendir(buf);
+  if (!dirp) return;
+
+  struct dirent *ent;
+  while ((ent = readdir(dirp)) != NULL) {
+    struct stat st;
+    if (fstatat(dirfd(dirp), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+    if (!S_ISLNK(st.st_mode)) continue;
+    if (unlinkat(dirfd(dirp), ent->d_name, 0) < 0) {
+      fprintf(stderr, "unlink errno %d '%s/%s'\n", errno, buf, ent->d_name);
+    }
   }
-  if (mkdir(buf, 0777) < 0 && errno != EEXIST) {
-    fprintf(stderr, "mkdir failed %d buf '%s'\n", errno, buf);
-    perror("  mkdir");
+  closedir(dirp);
+}
+
+/* ASCII case folding, same as strcasecmp() */
+void
+casefold(char *cp)
+{
+  for (; *cp; cp++) *cp = tolower((unsigned char)*cp);
+}
+
+/* entries of a directory read by scan_dir(), pairs of key and real path */
+struct _dirents {
+  char *buf;  // key '\0' real path '\0' ...
+  size_t len;
+  size_t size;
+};
+
+static void
+dirents_add(struct _dirents *dep, const char *key, const char *realpath)
+{
+  size_t klen = strlen(key) + 1;
+  size_t rlen = strlen(realpath) + 1;
+  if (dep->size < dep->len + klen + rlen) {
+    dep->size = dep->size ? dep->size * 2 : 4096;
+    if (dep->size < dep->len + klen + rlen) dep->size = dep->len + klen + rlen;
+    dep->buf = (char *)realloc(dep->buf, dep->size);
+    if (!dep->buf) {
+      fprintf(stderr, "dirents_add realloc failed\n");
+      exit(1);
+    }
   }
+  memcpy(dep->buf + dep->len, key, klen);
+  memcpy(dep->buf + dep->len + klen, realpath, rlen);
+  dep->len += klen + rlen;
 }
 
+/*
+ * read directory dirpath into dep, keyed by case folded name
+ * called without dirCacheLock, other workers are not blocked by a
+ * large directory
+ */
 void
-dirlist(const char *path, char *realpath, int bufsize)
+scan_dir(const char *dirpath, int prefix, struct _dirents *dep)
 {
-  realpath[0] = '\0';
-  cstr_value_t fp = NULL;
+  STATS_INC(n_dirscan);
+
+  DIR *dirp = opendir(dirpath);
+  if (!dirp) return;
 
-  int ret = item_get_str(realPathHash, path, &fp);
-  if (ret == 0) {
-    strncpy(realpath, fp, bufsize);
+  char key[BUFSIZE];
+  char realpath[BUFSIZE];
+  int dlen = snprintf(key, sizeof(key), "%s/", dirpath);
+  if ((int)sizeof(key) <= dlen) {
+    closedir(dirp);
     return;
   }
 
-  char npathent[BUFSIZE];
+  struct dirent *ent;
+  while ((ent = readdir(dirp)) != NULL) {
+    snprintf(key + dlen, sizeof(key) - dlen, "%s", ent->d_name);
+    casefold(key + dlen);
+    if (prefix) {
+      snprintf(realpath, sizeof(realpath), "%s/%s", dirpath, ent->d_name);
+    } else {
+      snprintf(realpath, sizeof(realpath), "%s", ent->d_name);
+    }
+    dirents_add(dep, key, realpath);
+  }
+  closedir(dirp);
+}
+
+/*
+ * index entries of dirpath read by scan_dir(), first entry of a case
+ * folded name wins
+ * called with dirCacheLock held
+ */
+void
+index_dir(const char *dirpath, struct _dirents *dep)
+{
+  int ret = item_set(dirScannedHash, dirpath, 1);
+  if (ret < 0) fprintf(stderr, "index_dir item_set %d\n", ret);
+
+  size_t off = 0;
+  while (off < dep->len) {
+    const char *key = dep->buf + off;
+    const char *realpath = key + strlen(key) + 1;
+    off = realpath + strlen(realpath) + 1 - dep->buf;
+    if (item_key(dirIndexHash, key) == 0) continue;
+    ret = item_set_str(dirIndexHash, key, realpath);
+    if (ret < 0) fprintf(stderr, "index_dir item_set_str %d\n", ret);
+  }
+}
+
+/*
+ * find the entry of path, ignoring case of last component
+ * realpath is "" if not found
+ */
+void
+dirlist(const char *path, char *realpath, int bufsize)
+{
+  realpath[0] = '\0';
+
   char dirpath[BUFSIZE];
+  char key[BUFSIZE];
 
   bzero((void *)dirpath, sizeof(dirpath));
 
-  char *lastslp = strrchr(path, '/');
+  const char *lastslp = strrchr(path, '/');
   if (lastslp) {
     memcpy(dirpath, path, lastslp - path);
-    strncpy(npathent, lastslp + 1, BUFSIZE);
+    snprintf(key, sizeof(key), "%s/%s", dirpath, lastslp + 1);
   } else {
     dirpath[0] = '.';
-    strncpy(npathent, path, BUFSIZE);
+    snprintf(key, sizeof(key), "./%s", path);
   }
+  casefold(key + strlen(dirpath) + 1);
 
-  DIR *dirp = opendir(dirpath);
-  if (!dirp) return;
+  pthread_mutex_lock(&dirCacheLock);
+  if (item_key(dirScannedHash, dirpath) == 0) {
+    STATS_INC(n_dirhit);
+  } else {
+    pthread_mutex_unlock(&dirCacheLock);
 
-  struct dirent *ent;
+    struct _dirents de = { NULL, 0, 0 };
+    scan_dir(dirpath, lastslp != NULL, &de);
 
-  while ((ent = readdir(dirp)) != NULL) {
-    if (strcasecmp(npathent, ent->d_name) == 0) {
-      if (lastslp) {
-        strncpy(realpath, dirpath, bufsize);
-        strncat(realpath, "/", bufsize);
-        strncat(realpath, ent->d_name, bufsize);
-      } else {
-        strncpy(realpath, ent->d_name, bufsize);
-      }
-      break;
-    }
+    pthread_mutex_lock(&dirCacheLock);
+    if (item_key(dirScannedHash, dirpath) != 0)  // not indexed by another worker meanwhile
+      index_dir(dirpath, &de);
+    free(de.buf);
   }
-  closedir(dirp);
-  if (realpath[0]) {
-    ret = item_set_str(realPathHash, path, realpath);
-    if (ret) fprintf(stderr, "dirlist() failed item_set_str ret %d\n", ret);
+
+  cstr_value_t fp = NULL;
+  if (item_get_str(dirIndexHash, key, &fp) == 0) {
+    snprintf(realpath, bufsize, "%s", fp);
   }
+  pthread_mutex_unlock(&dirCacheLock);
 }
 
 void
@@ -268,72 +411,77 @@ searchFile(const char *mispath, char *realpath, int bufsize)
   strncpy(realpath, path, bufsize);
 }
 
+/*
+ * filesystem part of a playlist item, run by command() or -j workers
+ */
 void
-command(const char *folder, const char *pname, int seq, struct _track *rp)
-{
-  const char *loc = rp->loc;
-
-  char path1[BUFSIZE]; // is the string used in creating the symbolic link
-  char path2[BUFSIZE]; // is the name of the file created
-  char *lc = strdup(loc);
-  char *sp = lc;
-  char *ep = lc + rmprefixlen; // skip prefix
-  
-  if (checkrm == 0) {
-    if (strncmp(lc, o_rmprefix, org_rmprefixlen) != 0) {
-      fprintf(stderr, "prefix string (-i option) '%s' is not prefix of Location '%s'\n",
-              o_rmprefix, lc);
-      free(lc);
-      exit(1);
-    }
-    checkrm++; // check once
+emit_link(struct _job *jp)
+{
+  char *path1 = jp->path1;
+  char *path2 = jp->path2;
+
+  /* link is made relative to playlist directory fd, if it is open */
+  int dfd = AT_FDCWD;
+  const char *lname = path2;
+  if (jp->pldir) {
+    dfd = jp->pldir->fd;
+    lname = strrchr(path2, '/') + 1;
   }
 
-  while (*ep) {
-    if (*ep == '%') {  // %XY -> char(0xXY)
-      *sp++ = deesc2(++ep);
-      ep += 2;
-    } else {
-      *sp++ = *ep++;
-    }
-  }
-  *sp = '\0';
-  
-  char *sl = strrchr(lc, '/') + 1;
-  snprintf(path1, sizeof(path1), "%s/%s", o_path, lc);
-  snprintf(path2, sizeof(path2), "%s/%s/%s/%03d_%s", o_pldir, folder, pname, seq, sl);
-  if (o_verbose) {
-    fprintf(stderr, "path1 (contents) '%s'\n", path1);
-    fprintf(stderr, "path2 (file    ) '%s'\n", path2);
-  }
-  
-  free(lc);
+  STATS_BEGIN(ph_emit);
 
   int e_path1 = 1;
-  struct stat st;
-  if (stat(path1, &st) < 0 && o_dry < 2) {
-
-    char path3[BUFSIZE];
-    searchFile(path1, path3, BUFSIZE);
+  time_t atime = 0, mtime = 0;
+  int cached = target_cached(jp, &atime, &mtime);
+  if (0 <= cached) STATS_INC(n_stat_cached);
+  if (cached == 0) {
+    fprintf(stderr, "stat no target '%s'\n", path1);
+    e_path1 = 0;
 
-    if (stat(path3, &st) < 0 && o_dry < 2) {
-      fprintf(stderr, "stat no target '%s'\n", path1);
-      e_path1 = 0;
+  } else if (cached < 0) {
+    struct stat st;
+    STATS_INC(n_stat);
+    if (src_stat(path1, &st) == 0) {
+      atime = st.st_atime;
+      mtime = st.st_mtime;
+      target_store(jp, 1, NULL, atime, mtime);
+
+    } else if (o_dry < 2) {
+      char path3[BUFSIZE];
+      STATS_INC(n_search);
+      searchFile(path1, path3, BUFSIZE);
+
+      STATS_INC(n_stat);
+      if (stat(path3, &st) < 0) {
+        fprintf(stderr, "stat no target '%s'\n", path1);
+        e_path1 = 0;
+        target_store(jp, 0, NULL, 0, 0);
 
-    } else {
-      if (o_verbose) {
-        fprintf(stderr, "missing target '%s'\n", path1);
-        fprintf(stderr, "search  target '%s'\n", path3);
+      } else {
+        if (o_verbose) {
+          fprintf(stderr, "missing target '%s'\n", path1);
+          fprintf(stderr, "search  target '%s'\n", path3);
+        }
+        atime = st.st_atime;
+        mtime = st.st_mtime;
+        target_store(jp, 1, path3, atime, mtime);
+        strncpy(path1, path3, BUFSIZE);
       }
-      strncpy(path1, path3, BUFSIZE);
     }
   }
 
   if (o_dry) {
+    pldir_release(jp->pldir);
+    STATS_END(ph_emit);
     return;
   }
 
-  if (symlink(path1, path2) < 0 && errno != EEXIST) {
+  if (symlinkat(path1, dfd, lname) == 0) {
+    STATS_INC(n_symlink);
+  } else if (errno == EEXIST) {
+    STATS_INC(n_eexist);
+  } else {
+    STATS_INC(n_symlink_err);
     fprintf(stderr, "symlink %d '%s' '%s'\n", errno, path2, path1);
     perror("symlink");
     e_path1 = 0;
@@ -343,10 +491,10 @@ command(const char *folder, const char *pname, int seq, struct _track *rp)
   if (e_path1)   {
     struct timespec ts[2]; // access, modified
     memset((void *)ts, 0, sizeof(ts));
-    ts[0].tv_sec = st.st_atime;
-    ts[1].tv_sec = st.st_mtime;
+    ts[0].tv_sec = atime;
+    ts[1].tv_sec = mtime;
 
-    if (utimensat(AT_FDCWD, path2, ts, AT_SYMLINK_NOFOLLOW) < 0) {
+    if (utimensat(dfd, lname, ts, AT_SYMLINK_NOFOLLOW) < 0) {
       fprintf(stderr, "utimensat errno %d path2 '%s'\n", errno, path2);
       perror("utimensat");
     }
@@ -355,8 +503,8 @@ command(const char *folder, const char *pname, int seq, struct _track *rp)
   if (e_path1) {
     struct timeval times[2]; // access, modified
     memset((void *)times, 0, sizeof(times));
-    times[0].tv_sec = st.st_atime;
-    times[1].tv_sec = st.st_mtime;
+    times[0].tv_sec = atime;
+    times[1].tv_sec = mtime;
 
     if (lutimes(path2, times) < 0) {
       fprintf(stderr, "lutimes errno %d path2 '%s'\n", errno, path2);
@@ -364,72 +512,243 @@ command(const char *folder, const char *pname, int seq, struct _track *rp)
     }
   }
 #endif
+  pldir_release(jp->pldir);
+  STATS_END(ph_emit);
+}
+
+/*
+ * link target of jp resolved by an earlier playlist item of the track
+ * return 1 found (path1 is replaced by the found path), 0 missing,
+ * -1 not resolved yet
+ */
+int
+target_cached(struct _job *jp, time_t *atp, time_t *mtp)
+{
+  struct _trec *rp = jp->rp;
+  if (!rp) return -1;
+
+  switch (__atomic_load_n(&rp->rstate, __ATOMIC_ACQUIRE)) {
+  case RS_FOUND:
+    if (rp->rpath) {
+      if (o_verbose) {
+        fprintf(stderr, "missing target '%s'\n", jp->path1);
+        fprintf(stderr, "search  target '%s'\n", rp->rpath);
+      }
+      snprintf(jp->path1, sizeof(jp->path1), "%s", rp->rpath);
+    }
+    *atp = rp->atime;
+    *mtp = rp->mtime;
+    return 1;
+  case RS_MISSING:
+    return 0;
+  }
+  return -1;
+}
+
+/*
+ * keep the link target of jp in its track record, first one wins
+ * found: path found by searchFile(), NULL: path1 itself
+ */
+void
+target_store(struct _job *jp, int exist, const char *found, time_t atime, time_t mtime)
+{
+  struct _trec *rp = jp->rp;
+  int none = RS_NONE;
+  if (!rp || !__atomic_compare_exchange_n(&rp->rstate, &none, RS_BUSY, 0,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+
+  if (found) {
+    pthread_mutex_lock(&targetLock);
+    rp->rpath = arena_strdup(&targetArena, found);
+    pthread_mutex_unlock(&targetLock);
+  }
+  rp->atime = atime;
+  rp->mtime = mtime;
+  __atomic_store_n(&rp->rstate, exist ? RS_FOUND : RS_MISSING, __ATOMIC_RELEASE);
+}
+
+/*
+ * run a job by io_uring (-u), workers (-j) or this thread
+ */
+void
+put_job(struct _job *jp)
+{
+  if (uring_put(jp) < 0 && workq_put(jp) < 0) {
+    emit_link(jp);
+  }
+}
+
+void
+pending_add(uint32_t trackid, struct _job *jp)
+{
+  if (pending.size <= pending.n * 2) {
+    pending.size = pending.size ? pending.size * 2 : 256;
+    pending.paths = (char **)realloc(pending.paths, pending.size * sizeof(char *));
+    pending.recs = (struct _trec **)realloc(pending.recs, pending.size / 2 * sizeof(struct _trec *));
+    if (!pending.paths || !pending.recs) {
+      fprintf(stderr, "pending_add realloc failed\n");
+      exit(1);
+    }
+  }
+  char idstr[12];
+  snprintf(idstr, sizeof(idstr), "%u", trackid);
+  pending.digest = state_digest(pending.digest, idstr);
+  pending.digest = state_digest(pending.digest, jp->path1);
+  pending.digest = state_digest(pending.digest, jp->path2);
+  pending.paths[pending.n * 2]     = strdup(jp->path1);
+  pending.paths[pending.n * 2 + 1] = strdup(jp->path2);
+  pending.recs[pending.n] = jp->rp;
+  pending.n++;
+}
+
+/*
+ * end of Playlist Items of playlist tp (-s)
+ * emit held jobs if the playlist is changed since previous run, or its
+ * directory is shared with another playlist of same name, the directory
+ * is cleaned only by its first playlist in this run
+ */
+void
+flush_playlist(struct _track *tp, const char *dname)
+{
+  int i, first;
+  int changed = !tp->pid || state_changed(tp->pid, pending.digest, dname) || tp->fresh;
+  if (state_dir(dname, &first) || changed) {
+    if (first && !tp->fresh && !o_dry) {
+      STATS_BEGIN(ph_folder);
+      clean_dir(dname);
+      STATS_END(ph_folder);
+    }
+    for (i = 0; i < pending.n; i++) {
+      struct _job job;
+      snprintf(job.path1, sizeof(job.path1), "%s", pending.paths[i * 2]);
+      snprintf(job.path2, sizeof(job.path2), "%s", pending.paths[i * 2 + 1]);
+      job.pldir = pldir_hold(tp->pldir);
+      job.rp = pending.recs[i];
+      put_job(&job);
+    }
+  } else if (o_verbose) {
+    fprintf(stderr, "unchanged playlist '%s'\n", dname);
+  }
+
+  for (i = 0; i < pending.n * 2; i++)
+    free(pending.paths[i]);
+  pending.n = 0;
+  pending.digest = STATE_DIGEST_INIT;
+}
+
+void
+command(const char *folder, struct _track *atp, uint32_t trackid, struct _trec *rp)
+{
+  struct _job job;
+  char *path1 = job.path1; // is the string used in creating the symbolic link
+  char *path2 = job.path2; // is the name of the file created
+
+  if (rp->flags & TR_RAWLOC) {
+    if (checkrm == 0) {
+      fprintf(stderr, "prefix string (-i option) '%s' is not prefix of Location '%s'\n",
+              o_rmprefix, rp->path);
+      exit(1);
+    }
+    fprintf(stderr, "Location not under prefix %s Track ID %u '%s'\n",
+            atp->name, trackid, rp->path);
+    return;
+  }
+  checkrm = 1; // first item is checked above
+
+  // rp->path is decoded once in track_path()
+  char *sl = strrchr(rp->path, '/') + 1;
+  size_t len = sl - rp->path + strlen(sl);
+  memcpy(path1, rp->path, len + 1);
+  job.rp = rp;
+  snprintf(path2, BUFSIZE, "%s/%s/%s/%03d_%s", o_pldir, folder, atp->name, atp->plseq++, sl);
+  if (o_verbose) {
+    fprintf(stderr, "path1 (contents) '%s'\n", path1);
+    fprintf(stderr, "path2 (file    ) '%s'\n", path2);
+  }
+
+  if (o_state) {
+    pending_add(trackid, &job);
+    return;
+  }
+  job.pldir = pldir_hold(atp->pldir);
+  put_job(&job);
 }
 
 void
 end_dict(struct _ud *udp)
 {
-  struct _dstack *dp = &ud.dstack[udp->sp];
+  struct _dstack *dp = &udp->dstack[udp->sp];
   struct _track *tp = &dp->track;
 
-  value_t dkey = -1;
-  item_get(ttHash, dp->keystr, &dkey);
-
   udp->sp--;
-  dp = &ud.dstack[udp->sp];
+  dp = &udp->dstack[udp->sp];
 
   fprintf(dfs, "%d dict end key %s\n", udp->sp, dp->keystr);
 
-  if (st_tracks == 2) {
+  if (udp->st_tracks == 2) {
     if (0 < tp->samplerate) {
-      fprintf(dfs, "isp key '%s' %d %d %d %d '%s' '%s' '%s' '%s'",
-              dp->keystr, tp->diskn, tp->diskc, tp->trackn, tp->trackc,
-              tp->kind, tp->name, tp->artist, tp->album);
-      if (tp->comments) {
-        fprintf(dfs, " '%s'", tp->comments);
+      if (o_debug) {
+        fprintf(dfs, "isp key '%s' %d %d %d %d '%s' '%s' '%s' '%s'",
+                dp->keystr, tp->diskn, tp->diskc, tp->trackn, tp->trackc,
+                tp->kind, tp->name, tp->artist, tp->album);
+        if (tp->comments) {
+          fprintf(dfs, " '%s'", tp->comments);
+        }
+        fprintf(dfs, "\n");
       }
-      fprintf(dfs, "\n");
       if (!tp->loc) {
-        fprintf(stderr, "null loc2 %s %s\n", tp->name, tp->album);
+        fprintf(stderr, "null loc2 Track ID %s\n", dp->keystr);
       }
 
-      int ret = item_set_pointer(trackHash, dp->keystr, (void *)tp, sizeof(struct _track));
-      if (ret) fprintf(stderr, "item_set_pointer ret %d\n", ret);
-
-      if (o_check) {
-        ret = item_inc_init(ntrackHash, dp->keystr, (value_t)1, NULL);
-        if (ret < 0) fprintf(stderr, "ntrackHash inc %d\n", ret);
+      uint32_t id;
+      if (tracktab_id(dp->keystr, dp->keylen, &id) < 0) {
+        fprintf(stderr, "bad Track ID '%s'\n", dp->keystr);
+      } else {
+        struct _trec *rp = (struct _trec *)arena_alloc(udp->arena, sizeof(struct _trec));
+        rp->path = tp->loc;
+        rp->flags = (tp->disabled ? TR_DISABLED : 0) | (tp->rawloc ? TR_RAWLOC : 0);
+        rp->nref = 0;
+        rp->full = NULL;
+        rp->rstate = RS_NONE;
+        rp->rpath = NULL;
+        if (o_fulltrack) {
+          rp->full = (struct _track *)arena_alloc(udp->arena, sizeof(struct _track));
+          memcpy(rp->full, tp, sizeof(struct _track));
+        }
+        if (udp->tl) {
+          tlist_add(udp->tl, id, rp);  // -t thread, put later in file order
+        } else {
+          tracktab_put(id, rp);
+        }
       }
-    } else {
-      clear_track(tp);
     }
+    // strings of tp are in udp->arena, no clear_track()
   }
-  if (st_playlists == 1) {
+  if (udp->st_playlists == 1) {
     fprintf(dfs, "end_dict st_playlists 1 name %s\n", tp->name);
     clear_track(tp);
-  } else if (st_playlists == 2) {
-    struct _dstack *ap = &ud.dstack[udp->sp - 1];
+  } else if (udp->st_playlists == 2) {
+    struct _dstack *ap = &udp->dstack[udp->sp - 1];
     struct _track  *atp = &ap->track;
-    fprintf(dfs, "%d end_dict st_playlists 2 id %s skip %d\n",
+    fprintf(dfs, "%d end_dict st_playlists 2 id %u skip %d\n",
             udp->sp, tp->trackid, atp->skip);
     if (!atp->skip) {
-      struct _track *rp;
-      int ret = item_get_pointer(trackHash, tp->trackid, (void *)&rp);
-      if (ret != 0) fprintf(stderr, "item_get_pointer trackHash ret %d\n", ret);
-
-      if (o_check) {
-        ret = item_inc_init(ntrackHash, tp->trackid, (value_t)1, NULL);
-        if (ret < 0) fprintf(stderr, "ntrackHash inc %d\n", ret);
+      struct _trec *rp = tracktab_get(tp->trackid);
+      if (!rp) {
+        fprintf(stderr, "unknown Track ID %u in '%s'\n", tp->trackid, atp->name);
+      } else if (o_check) {
+        rp->nref++;
       }
 
-      if (!rp->disabled) {
-        if (!rp->loc) {
+      if (rp && !(rp->flags & TR_DISABLED)) {
+        if (!rp->path) {
           // track without loc, iTunes error
-          fprintf(stderr, "null loc %s %s\n", atp->name, rp->name);
+          fprintf(stderr, "null loc %s Track ID %u\n", atp->name, tp->trackid);
         } else if (atp->ppid && atp->ppid[0] != '\0') {
           cstr_value_t fp = NULL;
           item_get_str(folderHash, atp->ppid, &fp);
-          command(fp, atp->name, atp->plseq++, rp);
+          command(fp, atp, tp->trackid, rp);
         } else {
           fprintf(stderr, "no parent %s\n", atp->name);
         }
@@ -438,11 +757,12 @@ end_dict(struct _ud *udp)
     clear_track(tp);
   }
 
-  if (0 < st_tracks) --st_tracks;
+  if (0 < udp->st_tracks) --udp->st_tracks;
   dp->keystr[0] = '\0';
+  dp->keylen = 0;
 }
 
-static void XMLCALL
+void XMLCALL
 element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
 {
   struct _ud *udp = (struct _ud *)userData;
@@ -450,24 +770,23 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
 
   udp->valid = 1;
 
-  value_t nt = -1;
-  int ret = item_get(ttHash, tag_name, &nt);
-  if (ret != 0) fprintf(stderr, "new tag name %s\n", tag_name);
+  int nt = tt_lookup(tag_name);
+  if (nt < 0) fprintf(stderr, "new tag name %s\n", tag_name);
 
   struct _dstack *dp = &udp->dstack[udp->sp];
   switch(nt) {
   case t_dict: // start
     {
-      value_t dkey = -1;
-      item_get(ttHash, dp->keystr, &dkey);
+      int dkey = tt_lookup(dp->keystr);
 
       fprintf(dfs, "%d dict start st_tracks %d pl %d key '%s'\n",
-              udp->sp, st_tracks, st_playlists, dp->keystr);
+              udp->sp, udp->st_tracks, udp->st_playlists, dp->keystr);
 
       if (dkey == t_tracks) {
-        st_tracks = 1;
-      } else if (st_tracks == 1 && numberp(dp->keystr)) {
-        st_tracks = 2;
+        udp->st_tracks = 1;
+        STATS_BEGIN(ph_ingest);
+      } else if (udp->st_tracks == 1 && numberp(dp->keystr)) {
+        udp->st_tracks = 2;
       } else {
         // no state change
       }
@@ -480,21 +799,21 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
       dp = &udp->dstack[udp->sp];
       dp->kind = nt;
       dp->next = t_none;
-      if (st_tracks == 2 || st_playlists)
+      if (udp->st_tracks == 2 || udp->st_playlists)
         fprintf(dfs, "stack %d clear track\n", udp->sp);
         bzero(&dp->track, sizeof(struct _track));
     }
     break;
   case t_array: // start
     {
-      value_t dkey = -1;
-      item_get(ttHash, dp->keystr, &dkey);
+      int dkey = tt_lookup(dp->keystr);
 
       fprintf(dfs, "%d %s start key '%s'\n", udp->sp, ttStr[nt], dp->keystr);
 
       if (dkey == t_playlists) {
-        st_playlists = 1;
-      } else if (st_playlists == 1 && dkey == t_playlistitems) {
+        udp->st_playlists = 1;
+        STATS_END(ph_ingest);
+      } else if (udp->st_playlists == 1 && dkey == t_playlistitems) {
         struct _track *tp = &dp->track;
 
         tp->skip = tp->master || tp->dkind || tp->folder || tp->ppid == NULL;
@@ -509,7 +828,10 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
             cstr_value_t fp = NULL;
             item_get_str(folderHash, tp->ppid, &fp);
             snprintf(fbuf, sizeof(fbuf), "%s/%s", fp, tp->name);
-            dir(fbuf);
+            STATS_BEGIN(ph_folder);
+            tp->fresh = dir(fbuf);
+            if (!o_dry) tp->pldir = pldir_open(fbuf);
+            STATS_END(ph_folder);
           }
         }
         if (tp->folder) {
@@ -527,14 +849,16 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
             snprintf(buf, sizeof(buf), "%s", tp->name);
           }
           if (!tp->master && !tp->dkind) {
+            STATS_BEGIN(ph_folder);
             dir(buf);
+            STATS_END(ph_folder);
           }
 
           int ret = item_set_str(folderHash, tp->pid, buf);
           if (ret < 0) fprintf(stderr, "item_set_str %d pid %s\n", ret, tp->pid);
         }
 
-        st_playlists = 2;
+        udp->st_playlists = 2;
       }
 
       if (STACKSIZE == ++udp->sp) {
@@ -550,6 +874,7 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
   case t_key: // start
     dp->next = t_key;
     dp->keystr[0] = '\0';
+    dp->keylen = 0;
     break;
 
   case t_integer: // start
@@ -557,12 +882,14 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
   case t_date:    // start
     dp->next = t_val;
     dp->valstr[0] = '\0';
+    dp->vallen = 0;
     break;
 
   case t_true:   // start
   case t_false:  // start
     dp->next = t_bool;
     dp->valstr[0] = '\0';
+    dp->vallen = 0;
     break;
 
   case t_plist:
@@ -577,21 +904,20 @@ element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[])
 #endif
 }
 
-static void XMLCALL
+void XMLCALL
 element_end(void *userData, const XML_Char *name)
 {
   struct _ud *udp = (struct _ud *)userData;
   udp->valid = 0;
 
-  value_t nt = -1;
-  int ret = item_get(ttHash, name, &nt);
-  if (ret != 0) fprintf(stderr, "new tag name %s\n", name);
+  int nt = tt_lookup(name);
+  if (nt < 0) fprintf(stderr, "new tag name %s\n", name);
 
   struct _dstack *dp = &udp->dstack[udp->sp];
 
-  value_t dkey = -1;
-  if (st_tracks == 2 || st_playlists == 1 || st_playlists == 2) {
-    item_get(ttHash, dp->keystr, &dkey);
+  int dkey = -1;
+  if (udp->st_tracks == 2 || udp->st_playlists == 1 || udp->st_playlists == 2) {
+    dkey = tt_lookup(dp->keystr);
   }
 
   switch(nt) {
@@ -603,16 +929,32 @@ element_end(void *userData, const XML_Char *name)
     udp->sp--;
     dp = &udp->dstack[udp->sp];
     fprintf(dfs, "%d %s end key '%s'\n", udp->sp, ttStr[nt], dp->keystr);
-    if (st_playlists == 2) {
-      --st_playlists;
-    } else if (st_playlists == 1) {
-      --st_playlists;
+    if (udp->st_playlists == 2 && o_state) {
+      struct _track *tp = &dp->track;
+      if (!tp->skip && tp->ppid && tp->ppid[0] != '\0') {
+        char fbuf[BUFSIZE];
+        cstr_value_t fp = NULL;
+        item_get_str(folderHash, tp->ppid, &fp);
+        snprintf(fbuf, sizeof(fbuf), "%s/%s", fp, tp->name);
+        flush_playlist(tp, fbuf);
+      }
+    }
+    if (udp->st_playlists == 2) {
+      struct _track *tp = &dp->track;
+      pldir_release(tp->pldir);
+      tp->pldir = NULL;
+    }
+    if (udp->st_playlists == 2) {
+      --udp->st_playlists;
+    } else if (udp->st_playlists == 1) {
+      --udp->st_playlists;
     }
 
     break;
 
   case t_key: // end
     dp->valstr[0] = '\0';
+    dp->vallen = 0;
     break;
   case t_integer: // end
   case t_string:  // end
@@ -625,7 +967,7 @@ element_end(void *userData, const XML_Char *name)
       fprintf(dfs, "%d array val %s ukey '%s'\n",
               udp->sp, dp->valstr, dpu->keystr);
     }
-    if (st_tracks == 2) {
+    if (udp->st_tracks == 2) {
       int ii = 0;
       if (nt == t_integer) ii = atoi(dp->valstr);
 
@@ -637,16 +979,21 @@ element_end(void *userData, const XML_Char *name)
       case t_trackc:     tp->trackc     = ii; break;
       case t_totaltime:  tp->totaltime  = ii; break;
       case t_samplerate: tp->samplerate = ii; break;
-      case t_kind:       tp->kind     = strdup(dp->valstr); break;
-      case t_name:       tp->name     = strdup(dp->valstr); break;
-      case t_artist:     tp->artist   = strdup(dp->valstr); break;
-      case t_comments:   tp->comments = strdup(dp->valstr); break;
-      case t_album:      tp->album    = strdup(dp->valstr); break;
-      case t_location:   tp->loc      = strdup(dp->valstr); break;
+      case t_location:   tp->loc      = track_path(udp->arena, dp->valstr, dp->vallen, &tp->rawloc); break;
       default: ;
       }
+      if (o_fulltrack) {  // descriptive fields, -c/-d only
+        switch(dkey) {
+        case t_kind:     tp->kind     = arena_intern(udp->arena, dp->valstr, dp->vallen); break;
+        case t_name:     tp->name     = arena_strdup(udp->arena, dp->valstr); break;
+        case t_artist:   tp->artist   = arena_intern(udp->arena, dp->valstr, dp->vallen); break;
+        case t_comments: tp->comments = arena_strdup(udp->arena, dp->valstr); break;
+        case t_album:    tp->album    = arena_intern(udp->arena, dp->valstr, dp->vallen); break;
+        default: ;
+        }
+      }
     }
-    if (st_playlists == 1) {
+    if (udp->st_playlists == 1) {
       int ii = 0;
       if (nt == t_integer) ii = atoi(dp->valstr);
 
@@ -658,28 +1005,29 @@ element_end(void *userData, const XML_Char *name)
       case t_dkind:  tp->dkind  = ii; break;
       default: ;
       }
-    } else if (st_playlists == 2) {
+    } else if (udp->st_playlists == 2) {
       struct _track *tp = &dp->track;
       switch(dkey) {
-      case t_trackid: tp->trackid = strdup(dp->valstr); break;
+      case t_trackid: tracktab_id(dp->valstr, dp->vallen, &tp->trackid); break;
       default: ;
       }
     }
     dp->keystr[0] = '\0';
+    dp->keylen = 0;
     break;
   case t_true:  // end
   case t_false: // end
     fprintf(dfs, "%d bool st_playlists %d key '%s' val %s %d\n",
-            udp->sp, st_playlists, dp->keystr, ttStr[nt], nt == t_true);
+            udp->sp, udp->st_playlists, dp->keystr, ttStr[nt], nt == t_true);
 
-    if (st_tracks == 2) {
+    if (udp->st_tracks == 2) {
       struct _track *tp = &dp->track;
       switch(dkey) {
       case t_disabled: tp->disabled = nt == t_true; break;
       default: ;
       }
     }
-    if (st_playlists == 1) {
+    if (udp->st_playlists == 1) {
       struct _track *tp = &dp->track;
       switch(dkey) {
       case t_folder: tp->folder = nt == t_true; break;
@@ -689,16 +1037,18 @@ element_end(void *userData, const XML_Char *name)
     }
 
     dp->keystr[0] = '\0';
+    dp->keylen = 0;
     break;
 
   case t_plist:
   default:
     dp->keystr[0] = '\0';
+    dp->keylen = 0;
     break;
   }
 }
 
-static void XMLCALL
+void XMLCALL
 char_handler(void *userData, const XML_Char *s, int len)
 {
   struct _ud *udp = (struct _ud *)userData;
@@ -709,20 +1059,280 @@ char_handler(void *userData, const XML_Char *s, int len)
   if (dp->next == t_none || dp->next == t_bool) return;
 
   char *vp = NULL;
-  if (dp->next == t_key) vp = dp->keystr;
-  else if (dp->next == t_val) vp = dp->valstr;
-  else {
+  int *lenp = NULL;
+  int size;
+  if (dp->next == t_key) {
+    vp = dp->keystr;
+    lenp = &dp->keylen;
+    size = KEYSIZE;
+  } else if (dp->next == t_val) {
+    vp = dp->valstr;
+    lenp = &dp->vallen;
+    size = VALSIZE;
+  } else {
     fprintf(stderr, "char_handler unk next\n");
     exit(1);
   }
 
-  int idx = strlen(vp);
-  if (VALSIZE <= len + idx) {
-    fprintf(stderr, "VALSIZE len %d idx %d sum %d\n", len, idx, len + idx);
+  int idx = *lenp;
+  if (size <= len + idx) {
+    fprintf(stderr, "%s len %d idx %d sum %d\n",
+            size == KEYSIZE ? "KEYSIZE" : "VALSIZE", len, idx, len + idx);
     exit(1);
   }
   memcpy(vp + idx, s, len);
   vp[idx + len] = '\0';
+  *lenp = idx + len;
+}
+
+/*
+ * empty parse stack, outside of Tracks and Playlists,
+ * track records and strings are allocated in ap
+ */
+void
+ud_init(struct _ud *udp, struct _arena *ap)
+{
+  udp->valid = 1;
+  udp->sp = 0;
+  udp->dstack[0].kind = t_array;
+  udp->dstack[0].next = t_none;
+  udp->dstack[0].keystr[0] = '\0';
+  udp->dstack[0].keylen = 0;
+  udp->dstack[0].valstr[0] = '\0';
+  udp->dstack[0].vallen = 0;
+  udp->st_tracks = 0;
+  udp->st_playlists = 0;
+  udp->arena = ap;
+  udp->tl = NULL;
+}
+
+/* return NULL on error */
+XML_Parser
+parser_create(struct _ud *udp)
+{
+  XML_Parser parser = XML_ParserCreate(NULL);
+  if (!parser) return NULL;
+  XML_SetUserData(parser, (void *)udp);
+  XML_SetElementHandler(parser, element_start, element_end);
+  XML_SetCharacterDataHandler(parser, char_handler);
+  return parser;
+}
+
+/*
+ * feed p[0..len) to parser by PARSEWINDOW size, final: p is the end of document
+ * return 0 on success, -1 on error
+ */
+int
+parse_buf(XML_Parser parser, const char *p, size_t len, int final)
+{
+  size_t off = 0;
+  do {
+    int n = PARSEWINDOW;
+    if (len - off < (size_t)n) n = (int)(len - off);
+
+    void *buf = XML_GetBuffer(parser, n);
+    if (!buf) {
+      fprintf(stderr, "XML_GetBuffer failed\n");
+      return -1;
+    }
+    memcpy(buf, p + off, n);
+    off += n;
+    STATS_ADD(xml_bytes, n);
+
+    /* XML parse */
+    if (XML_ParseBuffer(parser, n, final && len <= off) == 0) {
+      fprintf(stderr, "parser error line %lu: %s\n",
+              (unsigned long)XML_GetCurrentLineNumber(parser),
+              XML_ErrorString(XML_GetErrorCode(parser)));
+      return -1;
+    }
+  } while (off < len);
+  return 0;
+}
+
+/*
+ * -x, read stream fp into a buffer and scan it, a tag or text not
+ * complete at the end of buffer is moved to the head of buffer
+ * return 0 on success, -1 on error
+ */
+static int
+scan_stream(FILE *fp)
+{
+  size_t size = PARSEWINDOW * 2;
+  size_t n = 0;  // bytes in buf
+  char *buf = (char *)malloc(size);
+  int ret = 0;
+
+  if (!buf) {
+    fprintf(stderr, "scan_stream malloc failed\n");
+    return -1;
+  }
+  for (;;) {
+    if (size - n < PARSEWINDOW) {  // a tag or text longer than a window
+      char *nbuf = (char *)realloc(buf, size * 2);
+      if (!nbuf) {
+        fprintf(stderr, "scan_stream realloc failed\n");
+        ret = -1;
+        break;
+      }
+      buf = nbuf;
+      size *= 2;
+    }
+    size_t len = fread(buf + n, sizeof(char), size - n, fp);
+    if (ferror(fp)) {
+      fprintf(stderr, "file error\n");
+      ret = -1;
+      break;
+    }
+    n += len;
+    int eofflag = feof(fp);
+    long used = plscan(&scan, buf, n, eofflag);
+    if (used < 0) {
+      ret = -1;
+      break;
+    }
+    memmove(buf, buf + used, n - used);
+    n -= used;
+    if (eofflag) {
+      ret = plscan_end(&scan);
+      break;
+    }
+  }
+  free(buf);
+  return ret;
+}
+
+/*
+ * feed stream fp to parser, read directly into the expat buffer
+ * return 0 on success, -1 on error
+ */
+int
+parse_stream(XML_Parser parser, FILE *fp)
+{
+  if (o_scan) return scan_stream(fp);
+
+  int eofflag;
+  do {
+    void *buf = XML_GetBuffer(parser, PARSEWINDOW);
+    if (!buf) {
+      fprintf(stderr, "XML_GetBuffer failed\n");
+      return -1;
+    }
+    size_t len = fread(buf, sizeof(char), PARSEWINDOW, fp);
+    if (ferror(fp)) {
+      fprintf(stderr, "file error\n");
+      return -1;
+    }
+    STATS_ADD(xml_bytes, len);
+    eofflag = feof(fp);
+
+    /* XML parse */
+    if (XML_ParseBuffer(parser, (int)len, eofflag) == 0) {
+      fprintf(stderr, "parser error line %lu: %s\n",
+              (unsigned long)XML_GetCurrentLineNumber(parser),
+              XML_ErrorString(XML_GetErrorCode(parser)));
+      return -1;
+    }
+  } while (!eofflag);
+  return 0;
+}
+
+/*
+ * feed map[off..end) to parser (scan with -x), final: end is the end
+ * of file, otherwise a tag follows end
+ * return 0 on success, -1 on error
+ */
+static int
+parse_range(XML_Parser parser, char *map, size_t off, size_t end, int final)
+{
+  uintptr_t pmask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+  /* a page shared with the range before is left to it */
+  char *dropped = (char *)(((uintptr_t)map + off + pmask) & ~pmask);
+  size_t win = PARSEWINDOW;
+  while (off < end) {
+    size_t len = end - off < win ? end - off : win;
+    if (o_scan) {
+      long used = plscan(&scan, map + off, len, end <= off + len);
+      if (used < 0) return -1;
+      if (used == 0) {  // a tag or text longer than a window
+        win *= 2;
+        continue;
+      }
+      len = used;
+    } else if (parse_buf(parser, map + off, len, final && end <= off + len) < 0) {
+      return -1;
+    }
+    off += len;
+    /* pages already parsed are not needed any more */
+    char *pend = (char *)(((uintptr_t)map + off) & ~pmask);
+    if (dropped < pend) {
+      madvise(dropped, pend - dropped, MADV_DONTNEED);
+      dropped = pend;
+    }
+  }
+  return o_scan && final ? plscan_end(&scan) : 0;
+}
+
+/*
+ * mmap file and feed it to parser by PARSEWINDOW size,
+ * fall back to parse_stream() when file can not be mapped (pipe, etc)
+ * return 0 on success, -1 on error
+ */
+int
+parse_file(XML_Parser parser, const char *file)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open '%s'\n", file);
+    perror("  open");
+    return -1;
+  }
+
+  struct stat st;
+  char *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && 0 < st.st_size) {
+    map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+      close(fd);
+      return -1;
+    }
+    int ret = parse_stream(parser, fp);
+    fclose(fp);
+    return ret;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  int ret;
+  struct _ptrack pt;
+  if (1 < o_pthreads && !o_debug && ptrack_split(map, st.st_size, o_pthreads, &pt) == 0) {
+    /* Tracks dict body by -t threads, rest of the file by parser */
+    if (o_verbose) fprintf(stderr, "Tracks dict in %d chunks\n", pt.n);
+    ret = parse_range(parser, map, 0, pt.b, 0);
+    if (ret == 0) ret = ptrack_parse(&pt);
+    if (ret == 0) ret = parse_range(parser, map, pt.e, st.st_size, 1);
+  } else {
+    ret = parse_range(parser, map, 0, st.st_size, 1);
+  }
+
+  munmap(map, st.st_size);
+  close(fd);
+  return ret;
+}
+
+/*
+ * expected number of tracks from the size of library XML (-f file or
+ * redirected stdin), 0 if unknown (pipe)
+ */
+static unsigned long
+est_tracks()
+{
+  struct stat st;
+  int ret = o_file ? stat(o_file, &st) : fstat(0, &st);
+  if (ret < 0 || !S_ISREG(st.st_mode)) return 0;
+  return st.st_size / TRACKBYTES + 1;
 }
 
 static void mygetopt(int, char *[]);
@@ -733,9 +1343,6 @@ main(int argc, char *argv[])
 {
   mygetopt(argc, argv);
 
-  char buf[BUFSIZE];
-  int eofflag;
-  size_t len;
   XML_Parser parser;
   int ret;
 
@@ -747,6 +1354,8 @@ main(int argc, char *argv[])
     rmprefixlen++;
   }
 
+  o_pathlen = strlen(o_path);
+  o_fulltrack = o_check || o_debug;
   if (o_debug) {
     dfs = stderr;
   } else {
@@ -756,15 +1365,11 @@ main(int argc, char *argv[])
     fprintf(stderr, "cannot open /dev/null\n");
   }
 
-  ud.valid = 1;
-  ud.sp = 0;
-  ud.dstack[0].kind = t_array;
-  ud.dstack[0].next = t_none;
-  ud.dstack[0].keystr[0] = '\0';
-  ud.dstack[0].valstr[0] = '\0';
+  ud_init(&ud, &trackArena);
+  plscan_init(&scan, &ud);
 
 #ifdef COUNT
-  struct al_hash_t *ht_count = get_scalar_hash();
+  struct al_hash_t *ht_count = get_scalar_hash_capacity(_tt_last);
   if (!ht_count) exit(1);
   al_set_hash_err_msg(ht_count, "ht_count:");
   ud.hp = ht_count;
@@ -772,40 +1377,65 @@ main(int argc, char *argv[])
 
   init_tthash();
 
-  folderHash = get_string_hash();
+  unsigned long ntracks = est_tracks();
+  folderHash = get_string_hash_capacity(NFOLDERHINT);
 
-  ntrackHash = get_scalar_hash();
-  trackHash = get_pointer_hash();
-  al_set_pointer_hash_parameter(trackHash, NULL, clear_track_ent, NULL, NULL);
+  dirIndexHash = get_string_hash();
+  al_set_hash_err_msg(dirIndexHash, "dirIndexHash:");
+  dirScannedHash = get_scalar_hash();
+  al_set_hash_err_msg(dirScannedHash, "dirScannedHash:");
 
-  if ((parser = XML_ParserCreate(NULL)) == NULL) {
+  tracktab_init(ntracks);
+
+  if ((parser = parser_create(&ud)) == NULL) {
     fprintf(stderr, "parser creation error\n");
     exit(1);
   }
 
-  XML_SetUserData(parser, (void *)&ud);
-  XML_SetElementHandler(parser, element_start, element_end);
-  XML_SetCharacterDataHandler(parser, char_handler);
-
-  do {
-    len = fread(buf, sizeof(char), BUFSIZE, stdin);
-    if (ferror(stdin)) {
-      fprintf(stderr, "file error\n");
-      break;
+  if (o_state) {
+    if (state_load(o_state) < 0) {
+      fprintf(stderr, "cannot load state file '%s'\n", o_state);
+      exit(1);
     }
-    eofflag = feof(stdin);
+    pending.digest = STATE_DIGEST_INIT;
+  }
 
-    /* XML parse */
-    if ((XML_Parse(parser, buf, (int)len, eofflag)) == 0) {
-      fprintf(stderr, "parser error\n");
-      break;
-    }
-  } while (!eofflag);
+  fdcache_init();
+  if (!o_uring || uring_start() < 0) {
+    workq_start(o_jobs, emit_link, srccache_close);
+  }
+
+  STATS_BEGIN(ph_parse);
+  int perr;  // parser or scanner error, reported by it
+  if (o_file) {
+    perr = parse_file(parser, o_file);
+  } else {
+    perr = parse_stream(parser, stdin);
+  }
+  STATS_END(ph_ingest);  // no Playlists
+  STATS_END(ph_parse);
+
+  STATS_BEGIN(ph_wait);
+  uring_finish();
+  workq_finish();
+  STATS_END(ph_wait);
+
+  STATS_BEGIN(ph_teardown);
+  fdcache_close();
+
+  if (o_state) {
+    if (!o_dry && perr == 0) state_save(o_state);  // keep previous state on error
+    state_free();
+    free(pending.paths);
+    free(pending.recs);
+  }
 
-  // al_out_hash_stat(trackHash, "trackHash");
-  // al_out_hash_stat(ntrackHash, "ntrackHash");
+  if (o_stats) {
+    tracktab_stat("stats trackTab");
+    al_out_hash_stat(folderHash, "stats folderHash");
+  }
   if (o_check) {
-    print_ntrack(ntrackHash, trackHash);
+    tracktab_print_unref();
   }
 
 #ifdef COUNT
@@ -814,21 +1444,23 @@ main(int argc, char *argv[])
   if (ret < 0) fprintf(stderr, "free ht_count %d\n", ret);
 #endif
 
-  ret = al_free_hash(trackHash);
-  if (ret < 0) fprintf(stderr, "free trackHash %d\n", ret);
-
-  ret = al_free_hash(ntrackHash);
-  if (ret < 0) fprintf(stderr, "free ntrackHash %d\n", ret);
+  tracktab_free();
+  arena_free(&trackArena);
+  arena_free(&targetArena);
 
   ret = al_free_hash(folderHash);
   if (ret < 0) fprintf(stderr, "free folderHash %d\n", ret);
 
-  ret = al_free_hash(ttHash);
-  if (ret < 0) fprintf(stderr, "free ttHash %d\n", ret);
+  ret = al_free_hash(dirIndexHash);
+  if (ret < 0) fprintf(stderr, "free dirIndexHash %d\n", ret);
+  ret = al_free_hash(dirScannedHash);
+  if (ret < 0) fprintf(stderr, "free dirScannedHash %d\n", ret);
 
   XML_ParserFree(parser);
+  STATS_END(ph_teardown);
 
-  return 0;
+  if (o_stats) stats_print();
+  return perr < 0 ? 1 : 0;
 }
 
 #define optstr(var)\
@@ -854,10 +1486,20 @@ mygetopt (int argc, char *argv[])
       case 'p': optstr(o_path); break;
       case 'i': optstr(o_rmprefix); break;
       case 'o': optstr(o_pldir); break;
+      case 'f': optstr(o_file); break;
+      case 'j': optint(o_jobs); break;
+      case 't': optint(o_pthreads); break;
+      case 'x': o_scan = 1; break;
+      case 's': optstr(o_state); break;
+      case 'u': o_uring = 1; break;
       case 'c': o_check = 1; break;
       case 'n': o_dry++ ; break;
       case 'd': o_debug = 1; break;
       case 'v': o_verbose = 1; break;
+      case '-':
+        if (strcmp(str, "-stats") == 0) o_stats = 1;
+        else usage(argv[0]);
+        break;
       default:  usage(argv[0]);
       }
     }
@@ -868,7 +1510,7 @@ mygetopt (int argc, char *argv[])
 static void
 usage(char *file)
 {
-  fprintf(stderr, "%s [-n] -p path -i prefix \n", file);
+  fprintf(stderr, "%s [-n] -p path -i prefix [-o output] [-f file.xml [-t N]] [-x] [-j N | -u] [-s state] [--stats]\n", file);
   exit(1);
 }
 
@@ -12,6 +12,8 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <expat.h>
 #include <alhash.h>
 
 #define hexint(ch) \
@@ -22,10 +24,15 @@
 extern struct al_hash_t *get_scalar_hash();
 extern struct al_hash_t *get_string_hash();
 extern struct al_hash_t *get_pointer_hash();
+extern struct al_hash_t *get_scalar_hash_capacity(unsigned long n);
+extern struct al_hash_t *get_string_hash_capacity(unsigned long n);
+extern struct al_hash_t *get_pointer_hash_capacity(unsigned long n);
 extern void print_count(struct al_hash_t *ht_count);
-extern void print_ntrack(struct al_hash_t *hp, struct al_hash_t *thp);
 
 #define BUFSIZE 4096
+#define PARSEWINDOW (1024 * 1024)  // size of a chunk passed to XML_ParseBuffer
+#define TRACKBYTES 1024   // library XML bytes per track, estimate for track table size
+#define NFOLDERHINT 256   // initial capacity of folderHash
 #define KEYSIZE 128
 #define VALSIZE 8192
 #define STACKSIZE 64
@@ -95,8 +102,9 @@ struct _track {
   char *artist;
   char *comments;
   char *album;
-  char *loc;
-  char *trackid;
+  char *loc;      // track: o_path/decoded Location, see track_path()
+  int  rawloc;    // bool, loc is Location as is, not under -i prefix
+  uint32_t trackid; // Track ID of playlist item, 0: none
   int  disabled; // bool
 
   int  plseq;  // seq number in a playlist
@@ -107,27 +115,218 @@ struct _track {
   int folder;  // bool
 
   int skip;    // bool
+  int fresh;   // bool, playlist directory is created in this run
+  struct _pldir *pldir; // open playlist directory
 };
 
+/* track kept in track table, link emission needs path and flags only */
+struct _trec {
+  char *path;          // o_path/decoded Location (TR_RAWLOC: as is), in trackArena
+  unsigned int flags;  // TR_xxx
+  int nref;            // -c, number of playlist items of the track
+  struct _track *full; // all fields (-c/-d), NULL: compact record
+
+  /* link target, resolved by first emitted playlist item of the track */
+  int rstate;          // RS_xxx
+  char *rpath;         // found by searchFile(), NULL: path itself
+  time_t atime, mtime; // of link target
+};
+
+#define TR_DISABLED 0x1
+#define TR_RAWLOC   0x2  // path is Location not under -i prefix
+
+#define RS_NONE    0
+#define RS_BUSY    1  // being resolved by a thread
+#define RS_FOUND   2
+#define RS_MISSING 3
+
 struct _dstack {
   enum _tt kind;  // top/dict/array
   enum _tt next;  // top/key/val
   char keystr[KEYSIZE];
   char valstr[VALSIZE];
+  int keylen;     // strlen(keystr)
+  int vallen;     // strlen(valstr)
   struct _track track;
 };
 
+struct _arena;
+struct _tlist;
+
 struct _ud {
   int valid;  // 0 between end and start
   struct al_hash_t *hp;
   struct _dstack dstack[STACKSIZE];
   int sp;     // stack pointer
+  int st_tracks;    // 0: no track, 1: key is tracks, 2: get track elements
+  int st_playlists; // 0: no pl,    1: playlists,  2: playlist items
+  struct _arena *arena; // track records and its strings
+  struct _tlist *tl;    // -t thread, tracks to be put, NULL: put to track table
+};
+
+/* open playlist directory, shared by the playlist and its queued jobs */
+struct _pldir {
+  int fd;   // O_DIRECTORY
+  int ref;  // reference count
+};
+
+/* a playlist item to be linked */
+struct _job {
+  char path1[BUFSIZE]; // link contents
+  char path2[BUFSIZE]; // link name
+  struct _pldir *pldir; // directory of path2, NULL: use path2 as is
+  struct _trec *rp;     // track of path1, resolution is kept in it, may be NULL
+};
+
+/* fdcache.c */
+extern void fdcache_init();
+extern void fdcache_close();
+extern int pldir_rootfd();
+extern struct _pldir *pldir_open(const char *name);
+extern struct _pldir *pldir_hold(struct _pldir *pd);
+extern void pldir_release(struct _pldir *pd);
+extern int src_stat(const char *path1, struct stat *stp);
+extern void srccache_close();
+
+/* bump allocator, all objects are released at once */
+#define ARENA_BLKSIZE (1024 * 1024)
+
+struct _arena_blk {
+  struct _arena_blk *next;
+  size_t used;
+  size_t size;
+  char buf[];
+};
+
+struct _arena {
+  struct _arena_blk *blk;    // current block is head of the list
+  struct al_hash_t *intern;  // string -> interned string in arena
+};
+
+/* arena.c */
+extern void *arena_alloc(struct _arena *ap, size_t size);
+extern char *arena_strdup(struct _arena *ap, const char *s);
+extern char *arena_intern(struct _arena *ap, const char *s, size_t len);
+extern void arena_merge(struct _arena *dst, struct _arena *src);
+extern void arena_free(struct _arena *ap);
+
+extern struct _arena trackArena;  // track records and its strings
+
+/* tracktab.c */
+extern int tracktab_id(const char *s, size_t len, uint32_t *idp);
+extern void tracktab_init(unsigned long hint);
+extern void tracktab_put(uint32_t id, struct _trec *rp);
+extern struct _trec *tracktab_get(uint32_t id);
+extern void tracktab_each(void (*fn)(uint32_t id, struct _trec *rp, void *arg), void *arg);
+extern void tracktab_stat(const char *title);
+extern void tracktab_print_unref();
+extern void tracktab_free();
+
+/* Tracks dict split into chunks at track boundaries (-t) */
+#define PTRACKMAX 64
+
+struct _ptrack {
+  const char *map;        // mapped library XML
+  size_t b, e;            // body of Tracks dict, map[b..e)
+  int n;                  // number of chunks
+  size_t cut[PTRACKMAX + 1]; // chunk i is map[cut[i]..cut[i + 1])
+};
+
+/* tracks parsed by a -t thread */
+struct _tlist {
+  uint32_t *ids;
+  struct _trec **recs;
+  unsigned long n;
+  unsigned long size;
+};
+
+/* plscan.c, -x */
+#define PLSCANDEPTH (STACKSIZE * 2)
+
+struct _scan {
+  struct _ud *udp;
+  unsigned long off;  // bytes consumed, for error message
+  int depth;
+  int tag[PLSCANDEPTH]; // enum _tt of open elements
+};
+
+extern void plscan_init(struct _scan *sp, struct _ud *udp);
+extern long plscan(struct _scan *sp, const char *buf, size_t len, int final);
+extern int plscan_end(struct _scan *sp);
+
+/* ptrack.c */
+extern int ptrack_split(const char *map, size_t size, int nthreads, struct _ptrack *pp);
+extern int ptrack_parse(struct _ptrack *pp);
+extern void tlist_add(struct _tlist *tl, uint32_t id, struct _trec *rp);
+
+/* state.c */
+#define STATE_DIGEST_INIT 14695981039346656037UL  // FNV-1a 64bit offset basis
+
+extern uint64_t state_digest(uint64_t hv, const char *cp);
+extern int state_load(const char *file);
+extern int state_changed(const char *pid, uint64_t digest, const char *dname);
+extern int state_dir(const char *dname, int *firstp);
+extern int state_save(const char *file);
+extern void state_free();
+
+/* workq.c */
+extern int workq_start(int nthreads, void (*fn)(struct _job *), void (*efn)());
+extern int workq_put(const struct _job *jp);
+extern void workq_finish();
+
+/* itpl2dirtree.c */
+extern void XMLCALL element_start(void *userData, const XML_Char *tag_name, const XML_Char *atts[]);
+extern void XMLCALL element_end(void *userData, const XML_Char *name);
+extern void XMLCALL char_handler(void *userData, const XML_Char *s, int len);
+extern void ud_init(struct _ud *udp, struct _arena *ap);
+extern XML_Parser parser_create(struct _ud *udp);
+extern int parse_buf(XML_Parser parser, const char *p, size_t len, int final);
+extern void emit_link(struct _job *jp);
+extern int target_cached(struct _job *jp, time_t *atp, time_t *mtp);
+extern void target_store(struct _job *jp, int exist, const char *found,
+                         time_t atime, time_t mtime);
+
+/* uring.c */
+extern int uring_start();
+extern int uring_put(const struct _job *jp);
+extern void uring_finish();
+
+/* --stats, phases and counters */
+enum _phase { ph_parse, ph_ingest, ph_folder, ph_emit, ph_wait, ph_teardown, _ph_last };
+
+struct _stats {
+  uint64_t wall_ns[_ph_last];
+  uint64_t cpu_ns[_ph_last];
+  unsigned long calls[_ph_last];
+  unsigned long xml_bytes;     // XML consumed by parser
+  unsigned long n_stat;        // stat of link contents
+  unsigned long n_stat_cached; // link contents resolved by an earlier item
+  unsigned long n_search;      // searchFile() fallback
+  unsigned long n_dirhit;      // dirlist() served by dirIndexHash
+  unsigned long n_dirscan;     // directory read by dirlist(), cache miss
+  unsigned long n_symlink;     // created
+  unsigned long n_eexist;      // already exists
+  unsigned long n_symlink_err;
 };
 
-extern struct al_hash_t *ttHash;
+extern int o_stats;
+extern struct _stats stats;
+
+#define STATS_ADD(field, n) \
+  do { if (o_stats) __sync_fetch_and_add(&stats.field, (n)); } while (0)
+#define STATS_INC(field) STATS_ADD(field, 1)
+#define STATS_BEGIN(ph) do { if (o_stats) stats_begin(ph); } while (0)
+#define STATS_END(ph)   do { if (o_stats) stats_end(ph); } while (0)
+
+/* stats.c */
+extern void stats_begin(int ph);
+extern void stats_end(int ph);
+extern void stats_print();
+
 extern struct _tstr ttIdStr[];
 extern const char *ttStr[];
 
+extern int tt_lookup(const char *s);
 extern void init_tthash();
 
 #endif
@@ -0,0 +1,312 @@
+/*
+ *  plscan.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * built-in plist scanner (-x option), instead of expat
+ *
+ * iTunes library XML uses a small subset of XML, plist/dict/array/key/
+ * string/integer/date/true/false, no attribute is used.  Tags and text
+ * spans are passed to element_start(), element_end() and char_handler()
+ * as expat does: text is given only inside key and values, line breaks
+ * are given alone (char_handler() ignores them), entities are decoded
+ * only when a span has '&'.  '<' is searched 16 bytes at a time (SSE2),
+ * together with '&' and line breaks.
+ *
+ * comment, CDATA section, processing instruction and DOCTYPE are
+ * accepted, tag nesting is checked, but no other well-formedness check.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "itpl2dirtree.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const XML_Char *noatts[] = { NULL };
+
+void
+plscan_init(struct _scan *sp, struct _ud *udp)
+{
+  sp->udp = udp;
+  sp->off = 0;
+  sp->depth = 0;
+}
+
+static long
+scan_error(struct _scan *sp, const char *buf, const char *p, const char *msg)
+{
+  fprintf(stderr, "plscan error at byte %lu: %s\n", sp->off + (unsigned long)(p - buf), msg);
+  return -1;
+}
+
+/*
+ * first '<' in p[0..end), or end
+ * *special = 1 if '&', '\n' or '\r' is before it
+ */
+static const char *
+find_lt(const char *p, const char *end, int *special)
+{
+  int sp = 0;
+#if defined(__SSE2__)
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  while (16 <= end - p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lt));
+    unsigned int s = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, amp),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, nl),
+                                                    _mm_cmpeq_epi8(v, cr))));
+    if (m) {
+      int i = __builtin_ctz(m);
+      *special = sp || (s & ((1U << i) - 1)) != 0;
+      return p + i;
+    }
+    sp |= s != 0;
+    p += 16;
+  }
+#endif
+  const char *q = (const char *)memchr(p, '<', end - p);
+  if (!q) q = end;
+  for (; p < q; p++) {
+    if (*p == '&' || *p == '\n' || *p == '\r') sp = 1;
+  }
+  *special = sp;
+  return q;
+}
+
+static void
+put_utf8(char *buf, int *lenp, unsigned long c)
+{
+  unsigned char *u = (unsigned char *)buf;
+  if (c < 0x80) {
+    u[0] = c;
+    *lenp = 1;
+  } else if (c < 0x800) {
+    u[0] = 0xc0 | (c >> 6);
+    u[1] = 0x80 | (c & 0x3f);
+    *lenp = 2;
+  } else if (c < 0x10000) {
+    u[0] = 0xe0 | (c >> 12);
+    u[1] = 0x80 | ((c >> 6) & 0x3f);
+    u[2] = 0x80 | (c & 0x3f);
+    *lenp = 3;
+  } else {
+    u[0] = 0xf0 | (c >> 18);
+    u[1] = 0x80 | ((c >> 12) & 0x3f);
+    u[2] = 0x80 | ((c >> 6) & 0x3f);
+    u[3] = 0x80 | (c & 0x3f);
+    *lenp = 4;
+  }
+}
+
+/*
+ * entity at p ('&') to buf, return its length in p, -1 if unknown
+ */
+static int
+entity(const char *p, const char *end, char *buf, int *lenp)
+{
+  const char *q = (const char *)memchr(p, ';', end - p < 12 ? end - p : 12);
+  if (!q) return -1;
+  size_t n = q - p + 1;
+  *lenp = 1;
+
+  if (n == 5 && memcmp(p, "&amp;", 5) == 0)  { buf[0] = '&';  return 5; }
+  if (n == 4 && memcmp(p, "&lt;", 4) == 0)   { buf[0] = '<';  return 4; }
+  if (n == 4 && memcmp(p, "&gt;", 4) == 0)   { buf[0] = '>';  return 4; }
+  if (n == 6 && memcmp(p, "&quot;", 6) == 0) { buf[0] = '"';  return 6; }
+  if (n == 6 && memcmp(p, "&apos;", 6) == 0) { buf[0] = '\''; return 6; }
+  if (3 < n && p[1] == '#') {
+    unsigned long c = 0;
+    const char *cp = p + 2;
+    if (*cp == 'x') {
+      for (cp++; cp < q; cp++) {
+        if (!isxdigit((unsigned char)*cp)) return -1;
+        c = c * 16 + hexint(*cp);
+      }
+    } else {
+      for (; cp < q; cp++) {
+        if (!isdigit((unsigned char)*cp)) return -1;
+        c = c * 10 + (*cp - '0');
+      }
+    }
+    if (c == 0 || 0x10ffff < c) return -1;
+    put_utf8(buf, lenp, c);
+    return (int)n;
+  }
+  return -1;
+}
+
+/*
+ * text span p[0..n), return 0, or -1 on bad entity
+ */
+static int
+text(struct _scan *sp, const char *p, size_t n, int special, int cdata)
+{
+  struct _ud *udp = sp->udp;
+  if (!udp->valid) return 0;
+  enum _tt next = udp->dstack[udp->sp].next;
+  if (next != t_key && next != t_val) return 0;  // char_handler() ignores
+
+  if (!special) {
+    char_handler(udp, p, (int)n);
+    return 0;
+  }
+
+  const char *ep = p + n;
+  while (p < ep) {
+    const char *s = p;
+    while (p < ep && *p != '\n' && *p != '\r' && (cdata || *p != '&')) p++;
+    if (s < p) char_handler(udp, s, (int)(p - s));
+    if (ep <= p) break;
+
+    if (*p == '&') {
+      char buf[4];
+      int len;
+      int elen = entity(p, ep, buf, &len);
+      if (elen < 0) return -1;
+      char_handler(udp, buf, len);
+      p += elen;
+    } else {  // line break, CR LF and CR are LF
+      if (*p == '\r' && p + 1 < ep && p[1] == '\n') p++;
+      char_handler(udp, "\n", 1);
+      p++;
+    }
+  }
+  return 0;
+}
+
+/*
+ * '>' closing the tag at p, skipping quoted attribute values, NULL if
+ * not in p[0..end)
+ */
+static const char *
+tag_close(const char *p, const char *end)
+{
+  for (; p < end; p++) {
+    if (*p == '>') return p;
+    if (*p == '"' || *p == '\'') {
+      const char *q = (const char *)memchr(p + 1, *p, end - p - 1);
+      if (!q) return NULL;
+      p = q;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * scan buf[0..len), final: text up to len is complete (end of file or
+ * a tag follows)
+ * return number of bytes consumed, the rest is an incomplete tag or
+ * text to be given again with following bytes, -1 on error
+ */
+long
+plscan(struct _scan *sp, const char *buf, size_t len, int final)
+{
+  const char *p = buf, *end = buf + len;
+  char name[KEYSIZE];
+
+  while (p < end) {
+    if (*p != '<') {
+      int special;
+      const char *q = find_lt(p, end, &special);
+      if (q == end && !final) break;
+      if (text(sp, p, q - p, special, 0) < 0) return scan_error(sp, buf, p, "bad entity");
+      p = q;
+      continue;
+    }
+
+    if (end - p < 2) {
+      if (final) return scan_error(sp, buf, p, "incomplete tag");
+      break;
+    }
+
+    if (p[1] == '!' || p[1] == '?') {
+      const char *q = NULL;
+      size_t skip = 0;
+      if (9 <= end - p && memcmp(p, "<![CDATA[", 9) == 0) {
+        q = (const char *)memmem(p + 9, end - p - 9, "]]>", 3);
+        skip = 3;
+        if (q) text(sp, p + 9, q - p - 9, 1, 1);
+      } else if (4 <= end - p && memcmp(p, "<!--", 4) == 0) {
+        q = (const char *)memmem(p + 4, end - p - 4, "-->", 3);
+        skip = 3;
+      } else if (p[1] == '?') {
+        q = (const char *)memmem(p + 2, end - p - 2, "?>", 2);
+        skip = 2;
+      } else {  // <!DOCTYPE ...>, internal subset [...] ends with ]>
+        q = tag_close(p, end);
+        const char *ob = q ? (const char *)memchr(p, '[', q - p) : NULL;
+        skip = 1;
+        if (ob) {
+          q = (const char *)memmem(ob, end - ob, "]>", 2);
+          skip = 2;
+        }
+      }
+      if (!q) {
+        if (final) return scan_error(sp, buf, p, "incomplete markup");
+        break;
+      }
+      p = q + skip;
+      continue;
+    }
+
+    const char *q = tag_close(p + 1, end);
+    if (!q) {
+      if (final) return scan_error(sp, buf, p, "incomplete tag");
+      break;
+    }
+
+    int is_end = p[1] == '/';
+    const char *np = p + 1 + is_end;
+    const char *ne = np;
+    while (ne < q && *ne != '/' && !isspace((unsigned char)*ne)) ne++;
+    size_t nlen = ne - np;
+    if (nlen == 0) return scan_error(sp, buf, p, "no tag name");
+    if (KEYSIZE <= nlen) nlen = KEYSIZE - 1;
+    memcpy(name, np, nlen);
+    name[nlen] = '\0';
+    int id = tt_lookup(name);
+
+    if (is_end) {
+      if (sp->depth == 0 || sp->tag[sp->depth - 1] != id)
+        return scan_error(sp, buf, p, "mismatched tag");
+      sp->depth--;
+      element_end(sp->udp, name);
+    } else {
+      element_start(sp->udp, name, noatts);
+      if (q[-1] == '/') {  // <true/>, <dict/>
+        element_end(sp->udp, name);
+      } else {
+        if (PLSCANDEPTH <= sp->depth) return scan_error(sp, buf, p, "too deep");
+        sp->tag[sp->depth++] = id;
+      }
+    }
+    p = q + 1;
+  }
+
+  sp->off += p - buf;
+  STATS_ADD(xml_bytes, p - buf);
+  return p - buf;
+}
+
+/*
+ * end of file, all elements must be closed
+ * return 0 on success, -1 on error
+ */
+int
+plscan_end(struct _scan *sp)
+{
+  if (sp->depth == 0) return 0;
+  fprintf(stderr, "plscan error at byte %lu: %d elements not closed\n",
+          sp->off, sp->depth);
+  return -1;
+}
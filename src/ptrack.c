@@ -0,0 +1,250 @@
+/*
+ *  ptrack.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * parallel parse of the Tracks dict (-t option, with -f)
+ *
+ * The Tracks dict is a flat list of <key>ID</key><dict>...</dict>.
+ * ptrack_split() finds its body in the mapped library XML and cuts it
+ * after a track's </dict> into a chunk per thread.  ptrack_parse()
+ * parses each chunk, wrapped in <dict></dict>, by own expat parser
+ * (plscan with -x), _ud and arena, then puts the tracks into the track
+ * table in file order, so a duplicated Track ID ends as in the
+ * sequential parse.
+ * The rest of the file (Playlists) is left to the main parser.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "itpl2dirtree.h"
+
+extern int o_scan;
+
+/*
+ * find body of Tracks dict in map[0..size), and cut it into at most
+ * nthreads chunks
+ * return 0 on success, -1 if the file should be parsed sequentially
+ * (no Tracks dict, nested dict in a track, comment/CDATA, too small)
+ */
+int
+ptrack_split(const char *map, size_t size, int nthreads, struct _ptrack *pp)
+{
+  static const char tkey[] = "<key>Tracks</key>";
+  const char *end = map + size;
+  const char *p = (const char *)memmem(map, size, tkey, sizeof(tkey) - 1);
+  if (!p) return -1;
+  p += sizeof(tkey) - 1;
+  while (p < end && isspace((unsigned char)*p)) p++;
+  if (end - p < 6 || memcmp(p, "<dict>", 6) != 0) return -1;
+  p += 6;
+
+  /* end of Tracks dict, tracks must not have a dict in them */
+  uintptr_t pmask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+  const char *dropped = map;  // scanned pages are read again by threads
+  const char *q = p;
+  int depth = 1;
+  while (0 < depth) {
+    q = (const char *)memchr(q, '<', end - q);
+    if (!q || end - q < 8) return -1;
+    if (PARSEWINDOW <= q - dropped) {
+      const char *pend = (const char *)((uintptr_t)q & ~pmask);
+      madvise((void *)dropped, pend - dropped, MADV_DONTNEED);
+      dropped = pend;
+    }
+    q++;
+    if (*q == '!' || *q == '?') return -1;
+    if (memcmp(q, "dict>", 5) == 0) {
+      if (1 < depth) return -1;
+      depth++;
+    } else if (memcmp(q, "/dict>", 6) == 0) {
+      depth--;
+    }
+  }
+
+  if (PTRACKMAX < nthreads) nthreads = PTRACKMAX;
+  pp->map = map;
+  pp->b = p - map;
+  pp->e = q - 1 - map;  // '<' of </dict>
+  pp->n = 1;
+  pp->cut[0] = pp->b;
+
+  /* every </dict> in the body ends a track */
+  int i;
+  for (i = 1; i < nthreads; i++) {
+    size_t t = pp->b + (pp->e - pp->b) / nthreads * i;
+    if (t < pp->cut[pp->n - 1]) t = pp->cut[pp->n - 1];
+    const char *c = (const char *)memmem(map + t, pp->e - t, "</dict>", 7);
+    if (!c) break;
+    pp->cut[pp->n++] = c + 7 - map;
+  }
+  pp->cut[pp->n] = pp->e;
+  return pp->n < 2 ? -1 : 0;
+}
+
+void
+tlist_add(struct _tlist *tl, uint32_t id, struct _trec *rp)
+{
+  if (tl->size <= tl->n) {
+    tl->size = tl->size ? tl->size * 2 : 1024;
+    tl->ids = (uint32_t *)realloc(tl->ids, tl->size * sizeof(uint32_t));
+    tl->recs = (struct _trec **)realloc(tl->recs, tl->size * sizeof(struct _trec *));
+    if (!tl->ids || !tl->recs) {
+      fprintf(stderr, "tlist_add realloc failed\n");
+      exit(1);
+    }
+  }
+  tl->ids[tl->n] = id;
+  tl->recs[tl->n++] = rp;
+}
+
+struct pt_arg {
+  const char *p;        // chunk
+  size_t len;
+  struct _arena arena;  // records and strings of tracks in chunk
+  struct _tlist tl;
+  int ret;              // 0: ok, -1: error
+};
+
+/*
+ * feed chunk to parser (scanner sc with -x) by PARSEWINDOW size, drop
+ * parsed pages of the chunk, pages shared with next chunk are left to
+ * its thread
+ */
+static int
+parse_chunk(XML_Parser parser, struct _scan *sc, struct pt_arg *ap)
+{
+  uintptr_t pmask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+  uintptr_t pbeg = ((uintptr_t)ap->p + pmask) & ~pmask;
+  size_t win = PARSEWINDOW;
+  size_t off = 0;
+
+  while (off < ap->len) {
+    size_t len = ap->len - off < win ? ap->len - off : win;
+    if (sc) {
+      long used = plscan(sc, ap->p + off, len, ap->len <= off + len);
+      if (used < 0) return -1;
+      if (used == 0) {  // a tag or text longer than a window
+        win *= 2;
+        continue;
+      }
+      len = used;
+    } else if (parse_buf(parser, ap->p + off, len, 0) < 0) {
+      return -1;
+    }
+    off += len;
+    uintptr_t pend = ((uintptr_t)ap->p + off) & ~pmask;
+    if (pbeg < pend) madvise((void *)pbeg, pend - pbeg, MADV_DONTNEED);
+  }
+  return 0;
+}
+
+static void *
+pt_worker(void *a)
+{
+  struct pt_arg *ap = (struct pt_arg *)a;
+  ap->ret = -1;
+
+  struct _ud *udp = (struct _ud *)malloc(sizeof(struct _ud));
+  if (!udp) {
+    fprintf(stderr, "ptrack malloc failed\n");
+    return NULL;
+  }
+  ud_init(udp, &ap->arena);
+  udp->st_tracks = 1;  // in Tracks dict
+  udp->tl = &ap->tl;
+
+  if (o_scan) {  // -x, chunk is in a dict
+    const XML_Char *noatts[] = { NULL };
+    struct _scan *sc = (struct _scan *)malloc(sizeof(struct _scan));
+    if (sc) {
+      plscan_init(sc, udp);
+      element_start(udp, "dict", noatts);
+      if (parse_chunk(NULL, sc, ap) == 0) {
+        element_end(udp, "dict");
+        ap->ret = 0;
+      }
+      free(sc);
+    } else {
+      fprintf(stderr, "ptrack malloc failed\n");
+    }
+    free(udp);
+    return NULL;
+  }
+
+  XML_Parser parser = parser_create(udp);
+  if (!parser) {
+    fprintf(stderr, "parser creation error\n");
+    free(udp);
+    return NULL;
+  }
+  if (XML_Parse(parser, "<dict>", 6, 0) == 0 || parse_chunk(parser, NULL, ap) < 0) {
+    // parse_buf() reported it
+  } else if (XML_Parse(parser, "</dict>", 7, 1) == 0) {
+    fprintf(stderr, "parser error at end of Tracks chunk: %s\n",
+            XML_ErrorString(XML_GetErrorCode(parser)));
+  } else {
+    ap->ret = 0;
+  }
+  XML_ParserFree(parser);
+  free(udp);
+  return NULL;
+}
+
+/*
+ * parse chunks of pp, chunk 0 by this thread, and put the tracks into
+ * the track table
+ * return 0 on success, -1 on error
+ */
+int
+ptrack_parse(struct _ptrack *pp)
+{
+  struct pt_arg arg[PTRACKMAX];
+  pthread_t th[PTRACKMAX];
+  int started[PTRACKMAX];
+  int i, ret = 0;
+
+  memset(arg, 0, sizeof(arg));
+  for (i = 0; i < pp->n; i++) {
+    arg[i].p = pp->map + pp->cut[i];
+    arg[i].len = pp->cut[i + 1] - pp->cut[i];
+  }
+  for (i = 1; i < pp->n; i++) {
+    started[i] = pthread_create(&th[i], NULL, pt_worker, &arg[i]) == 0;
+  }
+  pt_worker(&arg[0]);
+  for (i = 1; i < pp->n; i++) {
+    if (started[i]) pthread_join(th[i], NULL);
+    else pt_worker(&arg[i]);
+  }
+
+  unsigned long j;
+  for (i = 0; i < pp->n; i++) {
+    for (j = 0; j < arg[i].tl.n; j++)
+      tracktab_put(arg[i].tl.ids[j], arg[i].tl.recs[j]);
+    arena_merge(&trackArena, &arg[i].arena);
+    free(arg[i].tl.ids);
+    free(arg[i].tl.recs);
+    if (arg[i].ret < 0) {
+      /* line number of parser error is counted from the chunk */
+      unsigned long line = 1;
+      const char *p = pp->map, *ep = pp->map + pp->cut[i];
+      while ((p = (const char *)memchr(p, '\n', ep - p)) != NULL) {
+        line++;
+        p++;
+      }
+      fprintf(stderr, "  in Tracks chunk %d, from line %lu\n", i, line);
+      ret = -1;
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,198 @@
+/*
+ *  state.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * state file for incremental re-sync (-s option)
+ *
+ * one line per playlist,
+ *   Playlist Persistent ID <TAB> digest of its items <TAB> its directory
+ * digest is FNV-1a 64bit of ordered (Track ID, link contents, link name)
+ *
+ * playlists of same name in a folder share a directory, such directory
+ * is rebuilt with all its playlists, and cleaned once in a run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "itpl2dirtree.h"
+
+static struct al_hash_t *oldStateHash = NULL; // pid -> digest, previous run
+static struct al_hash_t *newStateHash = NULL; // pid -> digest, this run
+static struct al_hash_t *oldDirHash = NULL;   // directory -> number of playlists, previous run
+static struct al_hash_t *newDirHash = NULL;   // directory -> number of playlists, this run
+
+/* FNV-1a step over cp, hv starts from STATE_DIGEST_INIT */
+uint64_t
+state_digest(uint64_t hv, const char *cp)
+{
+  do { // include terminating '\0' as separator
+    hv ^= (uint64_t)(unsigned char)*cp;
+    hv *= 1099511628211UL;
+  } while (*cp++);
+  return hv;
+}
+
+/*
+ * read state file, missing file is not an error (first run)
+ * file is read at once and oldStateHash is built in bulk from its lines
+ * return 0 on success, -1 on error
+ */
+int
+state_load(const char *file)
+{
+  oldStateHash = get_string_hash();
+  newStateHash = get_string_hash();
+  oldDirHash = get_scalar_hash();
+  newDirHash = get_scalar_hash();
+  if (!oldStateHash || !newStateHash || !oldDirHash || !newDirHash) return -1;
+  al_set_hash_err_msg(oldStateHash, "oldStateHash:");
+  al_set_hash_err_msg(newStateHash, "newStateHash:");
+  al_set_hash_err_msg(oldDirHash, "oldDirHash:");
+  al_set_hash_err_msg(newDirHash, "newDirHash:");
+
+  FILE *fp = fopen(file, "r");
+  if (!fp) return 0;
+
+  struct stat st;
+  if (fstat(fileno(fp), &st) < 0) {
+    fclose(fp);
+    return -1;
+  }
+  char *buf = (char *)malloc(st.st_size + 1);
+  size_t size = buf ? fread(buf, 1, st.st_size, fp) : 0;
+  fclose(fp);
+  if (!buf) return -1;
+  buf[size] = '\0';
+
+  size_t nline = 0, n = 0;
+  char *cp;
+  for (cp = buf; *cp; cp++)
+    if (*cp == '\n') nline++;
+  const char **keys = (const char **)malloc(sizeof(char *) * (nline + 1));
+  cstr_value_t *vals = (cstr_value_t *)malloc(sizeof(cstr_value_t) * (nline + 1));
+  if (!keys || !vals) {
+    free(keys);
+    free(vals);
+    free(buf);
+    return -1;
+  }
+
+  for (cp = buf; *cp; ) {
+    char *line = cp;
+    char *nl = strchr(cp, '\n');
+    if (nl) {
+      *nl = '\0';
+      cp = nl + 1;
+    } else {
+      cp += strlen(cp);
+    }
+    char *tab = strchr(line, '\t');
+    if (!tab) continue;
+    *tab++ = '\0';
+    keys[n] = line;
+    vals[n++] = tab;  // digest <TAB> directory, as state_changed() makes
+    char *dname = strchr(tab, '\t');
+    if (dname) {
+      int ret = item_inc_init(oldDirHash, dname + 1, 1, NULL);
+      if (ret < 0) fprintf(stderr, "state_load item_inc_init %d\n", ret);
+    }
+  }
+  int ret = al_hash_build_bulk_str(oldStateHash, keys, vals, n);
+  if (ret < 0) fprintf(stderr, "state_load al_hash_build_bulk_str %d\n", ret);
+
+  free(keys);
+  free(vals);
+  free(buf);
+  return 0;
+}
+
+/*
+ * record digest of playlist pid in directory dname
+ * return 1 if the playlist is new or changed since previous run, else 0
+ */
+int
+state_changed(const char *pid, uint64_t digest, const char *dname)
+{
+  char dstr[BUFSIZE];
+  snprintf(dstr, sizeof(dstr), "%016llx\t%s", (unsigned long long)digest, dname);
+
+  int ret = item_set_str(newStateHash, pid, dstr);
+  if (ret < 0) fprintf(stderr, "state_changed item_set_str %d pid %s\n", ret, pid);
+
+  cstr_value_t odstr = NULL;
+  if (item_get_str(oldStateHash, pid, &odstr) != 0) return 1;
+  return strcmp(odstr, dstr) != 0;
+}
+
+/*
+ * a playlist is put into directory dname
+ * return 1 if dname is shared with another playlist, in previous run
+ * or earlier in this run, all playlists of it must be rebuilt
+ * *firstp = 1 if dname is not used earlier in this run
+ */
+int
+state_dir(const char *dname, int *firstp)
+{
+  value_t used = 1, old = 0;  // used is not set when dname is added
+  int ret = item_inc_init(newDirHash, dname, 1, &used);
+  if (ret < 0) fprintf(stderr, "state_dir item_inc_init %d\n", ret);
+  item_get(oldDirHash, dname, &old);
+  *firstp = used == 1;
+  return 1 < used || 1 < old;
+}
+
+/*
+ * write state of this run, replace file atomically
+ * return 0 on success, -1 on error
+ */
+int
+state_save(const char *file)
+{
+  char tmp[BUFSIZE];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    fprintf(stderr, "cannot open state file '%s'\n", tmp);
+    return -1;
+  }
+
+  struct al_hash_iter_t *itr;
+  const char *pid;
+  cstr_value_t dstr;
+  int ret = al_hash_iter_init(newStateHash, &itr, AL_SORT_DIC|AL_ITER_AE);
+  if (ret < 0) {
+    fprintf(stderr, "state_save itr init %d\n", ret);
+    fclose(fp);
+    return -1;
+  }
+  while (0 <= (ret = al_hash_iter_str(itr, &pid, &dstr))) {
+    fprintf(fp, "%s\t%s\n", pid, dstr);
+  }
+  if (ret == 0) { // invoke _end() manually
+    al_hash_iter_end(itr);
+  }
+
+  if (fclose(fp) != 0 || rename(tmp, file) < 0) {
+    fprintf(stderr, "cannot write state file '%s'\n", file);
+    perror("  state");
+    return -1;
+  }
+  return 0;
+}
+
+void
+state_free()
+{
+  if (oldStateHash) al_free_hash(oldStateHash);
+  if (newStateHash) al_free_hash(newStateHash);
+  if (oldDirHash) al_free_hash(oldDirHash);
+  if (newDirHash) al_free_hash(newDirHash);
+  oldStateHash = newStateHash = NULL;
+  oldDirHash = newDirHash = NULL;
+}
@@ -0,0 +1,83 @@
+/*
+ *  stats.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * phase timing and counters (--stats option)
+ *
+ * phases overlap, XML is parsed as a stream: track ingest, folder
+ * creation and (without -j/-u) link emission run inside parse.
+ * Time of a phase is counted at its outermost STATS_BEGIN/STATS_END
+ * of each thread, emit is summed over all threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "itpl2dirtree.h"
+
+struct _stats stats;
+
+static const char *phName[] = {
+  "parse", "ingest", "folder", "emit", "emit wait", "teardown",
+};
+
+static __thread int ph_depth[_ph_last];
+static __thread struct timespec ph_wall0[_ph_last];
+static __thread struct timespec ph_cpu0[_ph_last];
+
+static uint64_t
+ts_ns(const struct timespec *tsp)
+{
+  return (uint64_t)tsp->tv_sec * 1000000000UL + tsp->tv_nsec;
+}
+
+void
+stats_begin(int ph)
+{
+  if (ph_depth[ph]++) return;
+  clock_gettime(CLOCK_MONOTONIC, &ph_wall0[ph]);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ph_cpu0[ph]);
+}
+
+void
+stats_end(int ph)
+{
+  if (ph_depth[ph] == 0 || --ph_depth[ph]) return;
+
+  struct timespec w, c;
+  clock_gettime(CLOCK_MONOTONIC, &w);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c);
+  __sync_fetch_and_add(&stats.wall_ns[ph], ts_ns(&w) - ts_ns(&ph_wall0[ph]));
+  __sync_fetch_and_add(&stats.cpu_ns[ph], ts_ns(&c) - ts_ns(&ph_cpu0[ph]));
+  __sync_fetch_and_add(&stats.calls[ph], 1);
+}
+
+void
+stats_print()
+{
+  int ph;
+  fprintf(stderr, "stats phase         wall(s)     cpu(s)      calls\n");
+  for (ph = 0; ph < _ph_last; ph++) {
+    fprintf(stderr, "stats %-12s %10.4f %10.4f %10lu\n", phName[ph],
+            stats.wall_ns[ph] / 1e9, stats.cpu_ns[ph] / 1e9, stats.calls[ph]);
+  }
+  fprintf(stderr, "stats xml bytes      %lu\n", stats.xml_bytes);
+  fprintf(stderr, "stats stat           %lu\n", stats.n_stat);
+  fprintf(stderr, "stats stat cached    %lu\n", stats.n_stat_cached);
+  fprintf(stderr, "stats searchFile     %lu\n", stats.n_search);
+  fprintf(stderr, "stats dirlist hit    %lu\n", stats.n_dirhit);
+  fprintf(stderr, "stats dirlist scan   %lu\n", stats.n_dirscan);
+  fprintf(stderr, "stats symlink        %lu\n", stats.n_symlink);
+  fprintf(stderr, "stats symlink EEXIST %lu\n", stats.n_eexist);
+  fprintf(stderr, "stats symlink error  %lu\n", stats.n_symlink_err);
+
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    fprintf(stderr, "stats maxrss(KB)     %ld\n", ru.ru_maxrss);
+}
@@ -0,0 +1,287 @@
+/*
+ *  tracktab.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * Track ID (integer) -> struct _trec * (in trackArena)
+ *
+ * direct indexed array while Track IDs are compact (iTunes numbers
+ * tracks from a base, mostly in steps of 2), open addressing hash
+ * keyed by uint32_t once IDs get sparse.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "itpl2dirtree.h"
+
+#define DENSE_MIN    1024   // initial size of direct array
+#define DENSE_SLACK  4      // direct while span of IDs <= DENSE_SLACK * (n + DENSE_MIN)
+#define TT_MINBIT    10
+
+struct tt_slot {
+  uint32_t id;
+  struct _trec *rp;   // NULL: empty slot
+};
+
+static struct {
+  int dense;               // 1: direct array, 0: hash
+  uint32_t base;           // dense, id of vec[0]
+  uint32_t lo, hi;         // dense, smallest and largest id stored
+  unsigned long size;      // dense, vec size / hash, number of slots
+  struct _trec **vec;
+  struct tt_slot *slot;
+  int bit;                 // hash, size == 1 << bit
+  unsigned long n;         // number of tracks
+  unsigned long hint;      // expected number of tracks
+} tt;
+
+/*
+ * decimal Track ID s[0..len) to *idp
+ * return 0 on success, -1 not a number or out of range
+ */
+int
+tracktab_id(const char *s, size_t len, uint32_t *idp)
+{
+  uint64_t v = 0;
+  size_t i;
+  if (len == 0 || 10 < len) return -1;
+  for (i = 0; i < len; i++) {
+    if (s[i] < '0' || '9' < s[i]) return -1;
+    v = v * 10 + (s[i] - '0');
+  }
+  if (UINT32_MAX < v) return -1;
+  *idp = (uint32_t)v;
+  return 0;
+}
+
+void
+tracktab_init(unsigned long hint)
+{
+  memset(&tt, 0, sizeof(tt));
+  tt.dense = 1;
+  tt.hint = hint;
+}
+
+static unsigned long
+tt_hv(uint32_t id, int bit)
+{
+  return (uint32_t)(id * 0x9e3779b1U) >> (32 - bit);
+}
+
+static void
+hash_place(struct tt_slot *slot, int bit, uint32_t id, struct _trec *rp)
+{
+  unsigned long mask = (1UL << bit) - 1;
+  unsigned long i = tt_hv(id, bit);
+  while (slot[i].rp && slot[i].id != id)
+    i = (i + 1) & mask;
+  slot[i].id = id;
+  slot[i].rp = rp;
+}
+
+static void
+hash_resize(int bit)
+{
+  struct tt_slot *slot = (struct tt_slot *)calloc(1UL << bit, sizeof(struct tt_slot));
+  if (!slot) {
+    fprintf(stderr, "tracktab calloc failed\n");
+    exit(1);
+  }
+  unsigned long i;
+  if (tt.dense) {
+    for (i = 0; i < tt.size; i++) {
+      if (tt.vec[i]) hash_place(slot, bit, tt.base + i, tt.vec[i]);
+    }
+    free(tt.vec);
+    tt.vec = NULL;
+    tt.dense = 0;
+  } else {
+    for (i = 0; i < tt.size; i++) {
+      if (tt.slot[i].rp) hash_place(slot, bit, tt.slot[i].id, tt.slot[i].rp);
+    }
+    free(tt.slot);
+  }
+  tt.slot = slot;
+  tt.bit = bit;
+  tt.size = 1UL << bit;
+}
+
+/* make vec cover [lo, hi], return -1 if too sparse for direct array */
+static int
+dense_cover(uint32_t lo, uint32_t hi)
+{
+  uint64_t span = (uint64_t)hi - lo + 1;
+  unsigned long n = tt.hint < tt.n ? tt.n : tt.hint;
+  if ((uint64_t)DENSE_SLACK * (n + DENSE_MIN) < span) return -1;
+
+  unsigned long size = tt.size ? tt.size : (tt.hint ? tt.hint * 2 : DENSE_MIN);
+  while (size < span) size *= 2;
+
+  struct _trec **vec = (struct _trec **)calloc(size, sizeof(struct _trec *));
+  if (!vec) {
+    fprintf(stderr, "tracktab calloc failed\n");
+    exit(1);
+  }
+  if (tt.n) {
+    memcpy(vec + (tt.lo - lo), tt.vec + (tt.lo - tt.base),
+           ((size_t)tt.hi - tt.lo + 1) * sizeof(struct _trec *));
+  }
+  free(tt.vec);
+  tt.vec = vec;
+  tt.base = lo;
+  tt.size = size;
+  return 0;
+}
+
+/* rp must live until tracktab_free(), same id replaces previous one */
+void
+tracktab_put(uint32_t id, struct _trec *rp)
+{
+  if (tt.dense && (!tt.vec || id < tt.base || tt.base + (uint64_t)tt.size <= id)) {
+    uint32_t lo = tt.n && tt.lo < id ? tt.lo : id;
+    uint32_t hi = tt.n && id < tt.hi ? tt.hi : id;
+    if (dense_cover(lo, hi) < 0) {
+      int bit = TT_MINBIT;
+      while ((1UL << bit) < (tt.n + 1) * 2) bit++;
+      hash_resize(bit);
+    }
+  }
+  if (tt.dense) {
+    if (!tt.vec[id - tt.base]) {
+      if (!tt.n || id < tt.lo) tt.lo = id;
+      if (!tt.n || tt.hi < id) tt.hi = id;
+      tt.n++;
+    }
+    tt.vec[id - tt.base] = rp;
+    return;
+  }
+
+  if (tt.size / 2 <= tt.n + 1)  // keep load under 1/2
+    hash_resize(tt.bit + 1);
+  unsigned long mask = tt.size - 1;
+  unsigned long i = tt_hv(id, tt.bit);
+  while (tt.slot[i].rp && tt.slot[i].id != id)
+    i = (i + 1) & mask;
+  if (!tt.slot[i].rp) tt.n++;
+  tt.slot[i].id = id;
+  tt.slot[i].rp = rp;
+}
+
+/* NULL if id is not found */
+struct _trec *
+tracktab_get(uint32_t id)
+{
+  if (tt.dense) {
+    if (!tt.vec || id < tt.base || tt.base + (uint64_t)tt.size <= id) return NULL;
+    return tt.vec[id - tt.base];
+  }
+
+  unsigned long mask = tt.size - 1;
+  unsigned long i = tt_hv(id, tt.bit);
+  while (tt.slot[i].rp) {
+    if (tt.slot[i].id == id) return tt.slot[i].rp;
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+/*
+ * call fn for each track, in no particular order
+ */
+void
+tracktab_each(void (*fn)(uint32_t id, struct _trec *rp, void *arg), void *arg)
+{
+  unsigned long i;
+  for (i = 0; i < tt.size; i++) {
+    if (tt.dense) {
+      if (tt.vec[i]) fn(tt.base + i, tt.vec[i], arg);
+    } else {
+      if (tt.slot[i].rp) fn(tt.slot[i].id, tt.slot[i].rp, arg);
+    }
+  }
+}
+
+void
+tracktab_stat(const char *title)
+{
+  if (tt.dense) {
+    fprintf(stderr, "%s direct base %u size %lu ids %u..%u ntrack %lu\n",
+            title, tt.base, tt.size, tt.lo, tt.hi, tt.n);
+    return;
+  }
+
+  unsigned long acl[11] = {0};
+  unsigned long i, mask = tt.size - 1;
+  for (i = 0; i < tt.size; i++) {
+    if (!tt.slot[i].rp) continue;
+    unsigned long dist = (i - tt_hv(tt.slot[i].id, tt.bit)) & mask;
+    acl[dist < 10 ? dist : 10]++;
+  }
+  fprintf(stderr, "%s hash bit %d ntrack %lu\n", title, tt.bit, tt.n);
+  for (i = 0; i < 11; i++)
+    fprintf(stderr, " %8lu", i);
+  fprintf(stderr, "\n");
+  for (i = 0; i < 11; i++)
+    fprintf(stderr, " %8lu", acl[i]);
+  fprintf(stderr, "\n");
+}
+
+struct unref {
+  char key[12];  // Track ID as string
+  struct _trec *rp;
+};
+
+struct unref_list {
+  struct unref *v;
+  unsigned long n;
+};
+
+static void
+add_unref(uint32_t id, struct _trec *rp, void *arg)
+{
+  struct unref_list *lp = (struct unref_list *)arg;
+  if (rp->nref) return;
+  snprintf(lp->v[lp->n].key, sizeof(lp->v[lp->n].key), "%u", id);
+  lp->v[lp->n++].rp = rp;
+}
+
+static int
+cmp_unref(const void *a, const void *b)
+{
+  return strcmp(((const struct unref *)a)->key, ((const struct unref *)b)->key);
+}
+
+/* -c, print tracks not in any playlist, dictionary order of Track ID */
+void
+tracktab_print_unref()
+{
+  struct unref_list l;
+  l.v = (struct unref *)malloc((tt.n + 1) * sizeof(struct unref));
+  l.n = 0;
+  if (!l.v) {
+    fprintf(stderr, "tracktab malloc failed\n");
+    return;
+  }
+  tracktab_each(add_unref, &l);
+  qsort(l.v, l.n, sizeof(struct unref), cmp_unref);
+
+  unsigned long i;
+  for (i = 0; i < l.n; i++) {
+    struct _trec *rp = l.v[i].rp;
+    struct _track *fp = rp->full;
+    fprintf(stderr, "track %s %s %s %s\n", l.v[i].key, fp->artist, fp->name, fp->album);
+  }
+  free(l.v);
+}
+
+void
+tracktab_free()
+{
+  free(tt.vec);
+  free(tt.slot);
+  memset(&tt, 0, sizeof(tt));
+}
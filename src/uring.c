@@ -0,0 +1,448 @@
+/*
+ *  uring.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * io_uring backend for link emission (-u option), Linux only
+ *
+ * jobs are collected into a batch of URINGDEPTH, then
+ *   1. statx of all link contents are submitted at once, except ones
+ *      resolved by an earlier playlist item of the same track, and
+ *      next batch is collected into the other buffer while they run
+ *   2. when next batch is full, statx completions are reaped, and
+ *      symlinkat of found ones are submitted at once (Linux 5.15+),
+ *      or done one by one when the kernel has no IORING_OP_SYMLINKAT
+ *   3. utimensat, io_uring has no such operation
+ * symlinkat is waited for in the batch, utimensat needs its result
+ * and io_uring can not chain an operation it does not have.
+ * a job whose statx failed is passed to emit_link(), searchFile() may
+ * find its real path.
+ *
+ * liburing is not required, rings are set up by raw system calls.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "itpl2dirtree.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URINGDEPTH 256  // jobs in a batch, and SQ entries
+
+extern int o_dry;
+extern int o_verbose;
+
+struct _uring {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+  int has_symlinkat;
+};
+
+static struct _uring ring = { .fd = -1 };
+
+/* a batch of jobs, and its sqes in the ring */
+struct _batch {
+  struct _job *jobs;
+  struct statx *stx;
+  int *res;    // result of last operation of each job
+  int n;       // number of jobs
+  int nsqe;    // sqes queued
+  int nsub;    // of them, taken by the kernel
+  int ndone;   // of them, completed
+};
+
+static struct _batch bat[2];
+static int cur = 0;  // bat[cur] is being collected, statx of the other may run
+
+static int
+uring_probe(int fd, int op)
+{
+  size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, size);
+  if (!probe) return 0;
+
+  int ret = 0;
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+      op <= probe->last_op) {
+    ret = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+  free(probe);
+  return ret;
+}
+
+static int
+uring_setup()
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = syscall(__NR_io_uring_setup, URINGDEPTH, &p);
+  if (fd < 0) return -1;
+
+  if (!uring_probe(fd, IORING_OP_STATX)) {
+    close(fd);
+    return -1;
+  }
+  ring.has_symlinkat = uring_probe(fd, IORING_OP_SYMLINKAT);
+
+  ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring.sq_size < ring.cq_size) ring.sq_size = ring.cq_size;
+    ring.cq_size = ring.sq_size;
+  }
+
+  ring.sq_ptr = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring.sq_ptr == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring.cq_ptr = ring.sq_ptr;
+  } else {
+    ring.cq_ptr = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring.cq_ptr == MAP_FAILED) {
+      munmap(ring.sq_ptr, ring.sq_size);
+      close(fd);
+      return -1;
+    }
+  }
+  ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring.sqes = (struct io_uring_sqe *)mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED) {
+    if (ring.cq_ptr != ring.sq_ptr) munmap(ring.cq_ptr, ring.cq_size);
+    munmap(ring.sq_ptr, ring.sq_size);
+    close(fd);
+    return -1;
+  }
+
+  ring.sq_tail  = (unsigned *)((char *)ring.sq_ptr + p.sq_off.tail);
+  ring.sq_mask  = (unsigned *)((char *)ring.sq_ptr + p.sq_off.ring_mask);
+  ring.sq_array = (unsigned *)((char *)ring.sq_ptr + p.sq_off.array);
+  ring.cq_head  = (unsigned *)((char *)ring.cq_ptr + p.cq_off.head);
+  ring.cq_tail  = (unsigned *)((char *)ring.cq_ptr + p.cq_off.tail);
+  ring.cq_mask  = (unsigned *)((char *)ring.cq_ptr + p.cq_off.ring_mask);
+  ring.cqes = (struct io_uring_cqe *)((char *)ring.cq_ptr + p.cq_off.cqes);
+  ring.fd = fd;
+  return 0;
+}
+
+static struct io_uring_sqe *
+get_sqe()
+{
+  unsigned tail = *ring.sq_tail;
+  unsigned idx = tail & *ring.sq_mask;
+  struct io_uring_sqe *sqe = &ring.sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  ring.sq_array[idx] = idx;
+  return sqe;
+}
+
+static void
+advance_sq()
+{
+  __atomic_store_n(ring.sq_tail, *ring.sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* completions to bp->res[user_data] */
+static void
+reap(struct _batch *bp)
+{
+  unsigned head = *ring.cq_head;
+  unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+    bp->res[cqe->user_data] = cqe->res;
+    head++;
+    bp->ndone++;
+  }
+  __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * submit queued sqes of bp, and wait all their completions if wait
+ * the kernel may take fewer sqes than asked (-EAGAIN, -EBUSY), the rest
+ * is given again, waiting only for completions of sqes it has taken
+ * return 0 on success, -1 on error
+ */
+static int
+uring_enter(struct _batch *bp, int wait)
+{
+  while (bp->nsub < bp->nsqe || (wait && bp->ndone < bp->nsqe)) {
+    int ret;
+    if (bp->nsub < bp->nsqe) {
+      ret = syscall(__NR_io_uring_enter, ring.fd, bp->nsqe - bp->nsub, 0, 0, NULL, 0);
+      if (0 < ret) {
+        bp->nsub += ret;
+        if (bp->nsub == bp->nsqe && !wait) break;
+      } else if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        perror("io_uring_enter");
+        return -1;
+      }
+    }
+    if (bp->ndone < bp->nsub) {
+      /* while sqes are left, a completion makes room for them */
+      ret = syscall(__NR_io_uring_enter, ring.fd, 0,
+                    bp->nsub < bp->nsqe ? 1 : bp->nsub - bp->ndone,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+      if (ret < 0 && errno != EINTR) {
+        perror("io_uring_enter");
+        return -1;
+      }
+    }
+    reap(bp);
+  }
+  return 0;
+}
+
+static void
+set_times(struct _job *jp, struct statx *stxp, int dfd, const char *lname)
+{
+  struct timespec ts[2]; // access, modified
+  memset((void *)ts, 0, sizeof(ts));
+  ts[0].tv_sec = stxp->stx_atime.tv_sec;
+  ts[1].tv_sec = stxp->stx_mtime.tv_sec;
+
+  if (utimensat(dfd, lname, ts, AT_SYMLINK_NOFOLLOW) < 0) {
+    fprintf(stderr, "utimensat errno %d path2 '%s'\n", errno, jp->path2);
+    perror("utimensat");
+  }
+}
+
+/* 1. submit statx of batch bp, not waiting for them */
+static void
+batch_stat(struct _batch *bp)
+{
+  int i;
+  bp->nsqe = bp->nsub = bp->ndone = 0;
+  for (i = 0; i < bp->n; i++) {
+    time_t atime, mtime;
+    int cached = target_cached(&bp->jobs[i], &atime, &mtime);
+    if (cached == 0) {  // emit_link() reports it
+      bp->res[i] = -ENOENT;
+      continue;
+    }
+    if (cached == 1) {
+      STATS_INC(n_stat_cached);
+      bp->stx[i].stx_atime.tv_sec = atime;
+      bp->stx[i].stx_mtime.tv_sec = mtime;
+      bp->res[i] = 0;
+      continue;
+    }
+    bp->res[i] = 1;  // statx submitted
+    bp->nsqe++;
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long)bp->jobs[i].path1;
+    sqe->len = STATX_ATIME | STATX_MTIME;
+    sqe->off = (unsigned long)&bp->stx[i];
+    sqe->user_data = i;
+    advance_sq();
+  }
+  STATS_ADD(n_stat, bp->nsqe);
+  if (bp->nsqe && uring_enter(bp, 0) < 0) {
+    for (i = 0; i < bp->n; i++)
+      if (bp->res[i] == 1) bp->res[i] = -1;
+    bp->nsqe = 0;
+  }
+}
+
+/* 2., 3. reap statx of batch bp, and make its links */
+static void
+batch_link(struct _batch *bp)
+{
+  int i;
+  if (bp->n == 0) return;
+
+  if (bp->nsqe && uring_enter(bp, 1) < 0) {
+    for (i = 0; i < bp->n; i++)
+      if (bp->res[i] == 1) bp->res[i] = -1;
+  }
+
+  for (i = 0; i < bp->n; i++) {
+    if (bp->res[i] == 0) {
+      target_store(&bp->jobs[i], 1, NULL,
+                   bp->stx[i].stx_atime.tv_sec, bp->stx[i].stx_mtime.tv_sec);
+    }
+    if (bp->res[i] < 0) {  // not found, or uring error
+      emit_link(&bp->jobs[i]);
+      bp->res[i] = 1;      // done
+    } else if (o_dry) {
+      pldir_release(bp->jobs[i].pldir);
+      bp->res[i] = 1;
+    }
+  }
+
+  /* 2. symlinkat */
+  bp->nsqe = bp->nsub = bp->ndone = 0;
+  for (i = 0; i < bp->n; i++) {
+    if (bp->res[i] == 1) continue;
+    struct _job *jp = &bp->jobs[i];
+    int dfd = jp->pldir ? jp->pldir->fd : AT_FDCWD;
+    const char *lname = jp->pldir ? strrchr(jp->path2, '/') + 1 : jp->path2;
+    if (ring.has_symlinkat) {
+      struct io_uring_sqe *sqe = get_sqe();
+      sqe->opcode = IORING_OP_SYMLINKAT;
+      sqe->fd = dfd;
+      sqe->addr = (unsigned long)jp->path1;
+      sqe->addr2 = (unsigned long)lname;
+      sqe->user_data = i;
+      advance_sq();
+      bp->nsqe++;
+    } else {
+      bp->res[i] = symlinkat(jp->path1, dfd, lname) < 0 ? -errno : 0;
+    }
+  }
+  if (bp->nsqe && uring_enter(bp, 1) < 0) {
+    for (i = 0; i < bp->n; i++)
+      if (bp->res[i] != 1) bp->res[i] = -EIO;
+  }
+
+  /* 3. utimensat */
+  for (i = 0; i < bp->n; i++) {
+    if (bp->res[i] == 1) continue;
+    struct _job *jp = &bp->jobs[i];
+    int dfd = jp->pldir ? jp->pldir->fd : AT_FDCWD;
+    const char *lname = jp->pldir ? strrchr(jp->path2, '/') + 1 : jp->path2;
+    if (bp->res[i] == 0 || bp->res[i] == -EEXIST) {
+      if (bp->res[i] == 0) STATS_INC(n_symlink);
+      else STATS_INC(n_eexist);
+      set_times(jp, &bp->stx[i], dfd, lname);
+    } else {
+      STATS_INC(n_symlink_err);
+      errno = -bp->res[i];
+      fprintf(stderr, "symlink %d '%s' '%s'\n", errno, jp->path2, jp->path1);
+      perror("symlink");
+    }
+    pldir_release(jp->pldir);
+  }
+  bp->n = 0;
+}
+
+/*
+ * link the batch collected before, its statx ran while bat[cur] was
+ * collected, then submit statx of bat[cur] and switch buffers
+ */
+static void
+uring_flush()
+{
+  STATS_BEGIN(ph_emit);
+  batch_link(&bat[cur ^ 1]);
+  batch_stat(&bat[cur]);
+  cur ^= 1;
+  STATS_END(ph_emit);
+}
+
+/*
+ * return 0 on success, -1 if io_uring is not available
+ */
+int
+uring_start()
+{
+  if (uring_setup() < 0) {
+    fprintf(stderr, "io_uring is not available, errno %d\n", errno);
+    return -1;
+  }
+  int i;
+  for (i = 0; i < 2; i++) {
+    bat[i].jobs = (struct _job *)malloc(sizeof(struct _job) * URINGDEPTH);
+    bat[i].stx = (struct statx *)malloc(sizeof(struct statx) * URINGDEPTH);
+    bat[i].res = (int *)malloc(sizeof(int) * URINGDEPTH);
+    if (!bat[i].jobs || !bat[i].stx || !bat[i].res) {
+      fprintf(stderr, "uring_start malloc failed\n");
+      exit(1);
+    }
+    bat[i].n = 0;
+  }
+  cur = 0;
+  if (o_verbose)
+    fprintf(stderr, "io_uring backend, symlinkat %s\n",
+            ring.has_symlinkat ? "async" : "sync");
+  return 0;
+}
+
+/*
+ * add a copy of *jp to the batch, run the batch when it is full
+ * return 0 on success, -1 when io_uring is not used
+ */
+int
+uring_put(const struct _job *jp)
+{
+  if (ring.fd < 0) return -1;
+  struct _batch *bp = &bat[cur];
+  memcpy(&bp->jobs[bp->n++], jp, sizeof(struct _job));
+  if (bp->n == URINGDEPTH)
+    uring_flush();
+  return 0;
+}
+
+void
+uring_finish()
+{
+  if (ring.fd < 0) return;
+  uring_flush();
+  uring_flush();  // links the last batch
+
+  munmap(ring.sqes, ring.sqes_size);
+  if (ring.cq_ptr != ring.sq_ptr) munmap(ring.cq_ptr, ring.cq_size);
+  munmap(ring.sq_ptr, ring.sq_size);
+  close(ring.fd);
+  ring.fd = -1;
+
+  int i;
+  for (i = 0; i < 2; i++) {
+    free(bat[i].jobs); bat[i].jobs = NULL;
+    free(bat[i].stx);  bat[i].stx = NULL;
+    free(bat[i].res);  bat[i].res = NULL;
+  }
+}
+
+#else /* HAVE_IO_URING */
+
+int
+uring_start()
+{
+  fprintf(stderr, "io_uring is not supported on this system\n");
+  return -1;
+}
+
+int
+uring_put(const struct _job *jp)
+{
+  return -1;
+}
+
+void
+uring_finish()
+{
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,137 @@
+/*
+ *  workq.c
+ *
+ *   Use and distribution licensed under the BSD license.
+ *   See the LICENSE file for full text.
+ */
+
+/*
+ * bounded job queue and worker threads for link emission (-j option)
+ *
+ * The expat callbacks are the only producer, worker threads consume
+ * jobs and run the filesystem part of a playlist item (stat, symlink,
+ * utimensat), so parsing goes on while the syscalls are in flight.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "itpl2dirtree.h"
+
+#define WORKQSIZE 256   // number of slots in ring buffer
+
+static struct _job *jobq = NULL;  // ring buffer
+static unsigned int q_head = 0;   // next slot to take
+static unsigned int q_tail = 0;   // next slot to put
+static int q_done = 0;            // 1: no more job will be put
+static pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_notempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t q_notfull = PTHREAD_COND_INITIALIZER;
+
+static pthread_t *workers = NULL;
+static int n_workers = 0;
+static void (*job_fn)(struct _job *) = NULL;
+static void (*end_fn)() = NULL;  // called by each worker before exit
+
+static void *
+worker(void *arg)
+{
+  struct _job job;
+
+  for (;;) {
+    pthread_mutex_lock(&q_lock);
+    while (q_head == q_tail && !q_done)
+      pthread_cond_wait(&q_notempty, &q_lock);
+    if (q_head == q_tail) { // q_done
+      pthread_mutex_unlock(&q_lock);
+      break;
+    }
+    memcpy(&job, &jobq[q_head % WORKQSIZE], sizeof(job));
+    q_head++;
+    pthread_cond_signal(&q_notfull);
+    pthread_mutex_unlock(&q_lock);
+
+    job_fn(&job);
+  }
+  if (end_fn) end_fn();
+  return NULL;
+}
+
+/*
+ * start nthreads workers calling fn for each job, and efn at end of worker
+ * return number of started workers, or -1 (no worker, run jobs by caller)
+ */
+int
+workq_start(int nthreads, void (*fn)(struct _job *), void (*efn)())
+{
+  if (nthreads <= 0) return -1;
+
+  jobq = (struct _job *)malloc(sizeof(struct _job) * WORKQSIZE);
+  workers = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+  if (!jobq || !workers) {
+    fprintf(stderr, "workq_start malloc failed\n");
+    free(jobq);    jobq = NULL;
+    free(workers); workers = NULL;
+    return -1;
+  }
+  job_fn = fn;
+  end_fn = efn;
+  q_head = q_tail = 0;
+  q_done = 0;
+
+  for (n_workers = 0; n_workers < nthreads; n_workers++) {
+    int ret = pthread_create(&workers[n_workers], NULL, worker, NULL);
+    if (ret != 0) {
+      fprintf(stderr, "pthread_create failed %d, %d workers\n", ret, n_workers);
+      break;
+    }
+  }
+  if (n_workers == 0) {
+    free(jobq);    jobq = NULL;
+    free(workers); workers = NULL;
+    return -1;
+  }
+  return n_workers;
+}
+
+/*
+ * put a copy of *jp to the queue, wait while the queue is full
+ * return 0 on success, -1 when no worker is running
+ */
+int
+workq_put(const struct _job *jp)
+{
+  if (n_workers == 0) return -1;
+
+  pthread_mutex_lock(&q_lock);
+  while (q_tail - q_head == WORKQSIZE)
+    pthread_cond_wait(&q_notfull, &q_lock);
+  memcpy(&jobq[q_tail % WORKQSIZE], jp, sizeof(struct _job));
+  q_tail++;
+  pthread_cond_signal(&q_notempty);
+  pthread_mutex_unlock(&q_lock);
+  return 0;
+}
+
+/*
+ * wait until all queued jobs are done, and stop workers
+ */
+void
+workq_finish()
+{
+  if (n_workers == 0) return;
+
+  pthread_mutex_lock(&q_lock);
+  q_done = 1;
+  pthread_cond_broadcast(&q_notempty);
+  pthread_mutex_unlock(&q_lock);
+
+  int i;
+  for (i = 0; i < n_workers; i++)
+    pthread_join(workers[i], NULL);
+
+  free(jobq);    jobq = NULL;
+  free(workers); workers = NULL;
+  n_workers = 0;
+}